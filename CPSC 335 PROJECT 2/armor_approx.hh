@@ -0,0 +1,281 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_approx.hh
+//
+// Approximate solvers that trade some defense for speed: local search on top
+// of greedy_max_defense, and a fully polynomial-time approximation scheme.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "armor_dp.hh"
+#include "maxtime.hh"
+
+
+// Improve start, a feasible selection from armors, by local search.
+// Each round applies the best of two kinds of move: add the item with the
+// most defense that still fits, or swap one chosen item for one left out
+// when that raises defense and stays within budget. Stops when no move
+// improves, or after max_rounds.
+// Costs are summed in units of 1 / armor_cost_scale(armors), rounding up
+// any that are not whole units, so rounding cannot build up however many
+// moves are made; the result is then re-checked in double as
+// tree_knapsack_max_defense's is.
+// The result lists items in their order in armors.
+std::unique_ptr<ArmorVector> local_search_max_defense
+(
+	const ArmorVector& armors,
+	double total_cost,
+	const ArmorVector& start,
+	int max_rounds = 1000
+)
+{
+	const size_t n = armors.size();
+	const int64_t scale = armor_cost_scale(armors);
+	const int64_t budget = armor_scaled_budget(total_cost, scale);
+
+	std::vector<int64_t> cost(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		cost[i] = armor_scaled_cost(armors[i]->cost(), scale);
+	}
+
+	std::unordered_map<const ArmorItem*, size_t> position;
+	for (size_t i = 0; i < n; i++)
+	{
+		position[armors[i].get()] = i;
+	}
+
+	std::vector<char> chosen(n, 0);
+	int64_t used = 0;
+	for (auto& armor : start)
+	{
+		auto found = position.find(armor.get());
+		assert(found != position.end());
+		if ( ! chosen[found->second] )
+		{
+			chosen[found->second] = 1;
+			used += cost[found->second];
+		}
+	}
+
+	for (int round = 0; round < max_rounds; round++)
+	{
+		// Best move: leave out -1 for a pure addition.
+		double best_gain = 0;
+		long best_in = -1, best_out = -1;
+
+		for (size_t j = 0; j < n; j++)
+		{
+			if (chosen[j] || armors[j]->defense() <= 0)
+			{
+				continue;
+			}
+			if (used + cost[j] <= budget)
+			{
+				if (armors[j]->defense() > best_gain)
+				{
+					best_gain = armors[j]->defense();
+					best_in = j;
+					best_out = -1;
+				}
+				continue;
+			}
+			for (size_t i = 0; i < n; i++)
+			{
+				if ( chosen[i]
+					&& used - cost[i] + cost[j] <= budget
+					&& armors[j]->defense() - armors[i]->defense() > best_gain )
+				{
+					best_gain = armors[j]->defense() - armors[i]->defense();
+					best_in = j;
+					best_out = i;
+				}
+			}
+		}
+
+		if (best_in < 0)
+		{
+			break;
+		}
+		chosen[best_in] = 1;
+		used += cost[best_in];
+		if (best_out >= 0)
+		{
+			chosen[best_out] = 0;
+			used -= cost[best_out];
+		}
+	}
+
+	std::vector<uint32_t> indexes;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (chosen[i])
+		{
+			indexes.push_back(i);
+		}
+	}
+	armor_fit_in_double(ArmorVectorAccess{ armors }, total_cost, indexes);
+	return armor_indexes_vector(armors, indexes);
+}
+
+
+// greedy_max_defense followed by local_search_max_defense.
+std::unique_ptr<ArmorVector> greedy_local_search_max_defense
+(
+	const ArmorVector& armors,
+	double total_cost
+)
+{
+	auto start = greedy_max_defense(armors, total_cost);
+	return local_search_max_defense(armors, total_cost, *start);
+}
+
+
+// Bytes of heap fptas_max_defense will use for these arguments: the
+// cheapest-cost table and one choice bit per candidate and rounded defense.
+// Needs the same O(n) pass over armors as the solver's own setup.
+size_t fptas_footprint
+(
+	const ArmorVector& armors,
+	double total_cost,
+	double epsilon
+)
+{
+	assert(epsilon > 0);
+
+	size_t m = 0;
+	double largest = 0;
+	for (auto& armor : armors)
+	{
+		if (armor->defense() > 0 && armor->cost() <= total_cost)
+		{
+			m++;
+			largest = std::max(largest, armor->defense());
+		}
+	}
+	if (m == 0)
+	{
+		return 0;
+	}
+
+	const double unit = epsilon * largest / m;
+	size_t total_profit = 0;
+	for (auto& armor : armors)
+	{
+		if (armor->defense() > 0 && armor->cost() <= total_cost)
+		{
+			total_profit += size_t(armor->defense() / unit);
+		}
+	}
+
+	const size_t cells = total_profit + 1;
+	return cells * sizeof(double) + m * ((cells + 63) / 64 * 8 + sizeof(std::vector<bool>)) + m * 4 * sizeof(int64_t);
+}
+
+
+// Compute a set of armor items with at least (1 - epsilon) times the optimal
+// defense, in time polynomial in n and 1 / epsilon.
+// Defenses are rounded down to multiples of K = epsilon * D / n, where D is
+// the largest defense of an item that fits on its own; an exact DP then
+// finds the cheapest way to reach every rounded total, which takes
+// O(n^2 / epsilon) cells per item, and a bit per cell to reconstruct the
+// choice. Rounding loses less than K per chosen item, so less than
+// epsilon * D <= epsilon * optimum in total.
+// Costs are summed in double, so the table needs no cost scale and any
+// costs keep the guarantee; the result is re-checked in double, in index
+// order, as tree_knapsack_max_defense's is.
+// The result lists items in their order in armors.
+std::unique_ptr<ArmorVector> fptas_max_defense
+(
+	const ArmorVector& armors,
+	double total_cost,
+	double epsilon
+)
+{
+	assert(epsilon > 0);
+
+	std::vector<uint32_t> candidates;
+	double largest = 0;
+	for (size_t i = 0; i < armors.size(); i++)
+	{
+		if (armors[i]->defense() > 0 && armors[i]->cost() <= total_cost)
+		{
+			candidates.push_back(i);
+			largest = std::max(largest, armors[i]->defense());
+		}
+	}
+
+	std::unique_ptr<ArmorVector> output(new ArmorVector);
+	const size_t m = candidates.size();
+	if (m == 0)
+	{
+		return output;
+	}
+
+	const double unit = epsilon * largest / m;
+	std::vector<double> cost(m);
+	std::vector<int64_t> profit(m);
+	int64_t total_profit = 0;
+	for (size_t k = 0; k < m; k++)
+	{
+		cost[k] = armors[candidates[k]]->cost();
+		profit[k] = int64_t(armors[candidates[k]]->defense() / unit);
+		total_profit += profit[k];
+	}
+
+	// cheapest[p] is the least cost of reaching rounded defense exactly p,
+	// or infinity if none does.
+	std::vector<double> cheapest(total_profit + 1, INFINITY);
+	std::vector<std::vector<bool>> take(m, std::vector<bool>(total_profit + 1, false));
+	cheapest[0] = 0;
+	for (size_t k = 0; k < m; k++)
+	{
+		for (int64_t p = total_profit; p >= profit[k]; p--)
+		{
+			double with = cheapest[p - profit[k]] + cost[k];
+			if (with < cheapest[p])
+			{
+				cheapest[p] = with;
+				take[k][p] = true;
+			}
+		}
+	}
+
+	int64_t p = total_profit;
+	while (cheapest[p] > total_cost)
+	{
+		p--;
+	}
+
+	std::vector<char> chosen(armors.size(), 0);
+	for (size_t k = m; k-- > 0; )
+	{
+		if (take[k][p])
+		{
+			chosen[candidates[k]] = 1;
+			p -= profit[k];
+		}
+	}
+
+	std::vector<uint32_t> indexes;
+	for (size_t i = 0; i < armors.size(); i++)
+	{
+		if (chosen[i])
+		{
+			indexes.push_back(i);
+		}
+	}
+	armor_fit_in_double(ArmorVectorAccess{ armors }, total_cost, indexes);
+	return armor_indexes_vector(armors, indexes);
+}
@@ -0,0 +1,219 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_batch.hh
+//
+// Batches of filter-and-solve queries against one loaded armor catalogue,
+// solved in parallel and reported in query order.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "armor_solver.hh"
+#include "maxtime.hh"
+
+
+// One query: filter the catalogue like filter_armor_vector, then solve the
+// filtered items within budget using the named registered solver.
+struct ArmorQuery
+{
+	double min_defense;
+	double max_defense;
+	int total_size;
+	double budget;
+
+	// Name of a solver in armor_solvers(), e.g. "greedy" or "exhaustive", or
+	// ARMOR_AUTO_SOLVER to pick an exact one by profiling each query's items.
+	std::string algorithm;
+};
+
+
+// Load a query file. Like the armor database, it is '^'-separated with a
+// header row, and each following line is
+//	min_defense^max_defense^total_size^budget^algorithm
+// Blank lines are ignored.
+// The algorithm must be a registered solver, and total_size at most its
+// ArmorSolverCapabilities::fast_n, so that no query pins a worker for much
+// longer than a second (exhaustive accepts up to 63 items, but 2^63 subsets
+// would never finish). An ARMOR_AUTO_SOLVER query is held to the fast_n of
+// branch_and_bound, which it is given whenever there are too many items for
+// tree_dp.
+// Returns nullptr on I/O error or an invalid query, after printing why.
+std::unique_ptr<std::vector<ArmorQuery>> load_armor_queries(const std::string& path)
+{
+	std::unique_ptr<std::vector<ArmorQuery>> failure(nullptr);
+
+	std::ifstream f(path);
+	if (!f)
+	{
+		std::cout << "Failed to load queries; Cannot open file: " << path << std::endl;
+		return failure;
+	}
+
+	std::unique_ptr<std::vector<ArmorQuery>> result(new std::vector<ArmorQuery>);
+
+	size_t line_number = 0;
+	for (std::string line; std::getline(f, line); )
+	{
+		line_number++;
+
+		if ( ! line.empty() && line.back() == '\r' )
+		{
+			line.pop_back();
+		}
+
+		// First line is a header row
+		if ( line_number == 1 || line.empty() )
+		{
+			continue;
+		}
+
+		std::vector<std::string> fields;
+		std::stringstream ss(line);
+		for (std::string field; std::getline(ss, field, '^'); )
+		{
+			fields.push_back(field);
+		}
+
+		ArmorQuery query;
+		bool valid = fields.size() == 5;
+		if (valid)
+		{
+			std::stringstream numbers(fields[0] + " " + fields[1] + " " + fields[2] + " " + fields[3]);
+			numbers >> query.min_defense >> query.max_defense >> query.total_size >> query.budget;
+			query.algorithm = fields[4];
+			const ArmorSolver* solver = find_armor_solver(query.algorithm == ARMOR_AUTO_SOLVER ? "branch_and_bound" : query.algorithm);
+			valid = bool(numbers)
+				&& query.total_size >= 0
+				&& solver
+				;
+			if (valid && size_t(query.total_size) > solver->capabilities().fast_n)
+			{
+				std::cout
+					<< "Failed to load queries: total_size at line " << line_number
+					<< " exceeds the " << solver->capabilities().fast_n << " items " << query.algorithm << " solves quickly" << std::endl
+					;
+				return failure;
+			}
+		}
+
+		if ( ! valid )
+		{
+			std::cout
+				<< "Failed to load queries: Invalid query at line " << line_number << std::endl
+				<< "Line: " << line << std::endl
+				;
+			return failure;
+		}
+
+		result->push_back(query);
+	}
+
+	return result;
+}
+
+
+// Filter armors and solve one query; context receives what the solver
+// reports, including the solution's optimality gap.
+std::unique_ptr<ArmorVector> solve_armor_query(const ArmorVector& armors, const ArmorQuery& query, ArmorSolveContext& context)
+{
+	auto filtered = filter_armor_vector(armors, query.min_defense, query.max_defense, query.total_size);
+
+	std::string algorithm = query.algorithm;
+	if (algorithm == ARMOR_AUTO_SOLVER)
+	{
+		algorithm = armor_exact_solver_for(profile_armor_vector(*filtered));
+	}
+
+	const ArmorSolver* solver = find_armor_solver(algorithm);
+	assert(solver);
+	return solver->solve(*filtered, query.budget, context);
+}
+
+
+// Filter armors and solve one query.
+std::unique_ptr<ArmorVector> solve_armor_query(const ArmorVector& armors, const ArmorQuery& query)
+{
+	ArmorSolveContext context;
+	return solve_armor_query(armors, query, context);
+}
+
+
+// Callback that receives each query's solution and solve context, in query
+// order.
+typedef std::function<void(size_t index, const ArmorVector& solution, const ArmorSolveContext& context)> ArmorQueryVisitor;
+
+
+// Solve every query against armors on thread_count worker threads, and pass
+// the solutions to visit strictly in query order, from the calling thread.
+// A solution is handed over and freed as soon as every earlier one has been,
+// so fast queries queued behind a slow one are the only ones held in memory.
+void solve_armor_queries
+(
+	const ArmorVector& armors,
+	const std::vector<ArmorQuery>& queries,
+	unsigned thread_count,
+	const ArmorQueryVisitor& visit
+)
+{
+	thread_count = std::max(1u, std::min<unsigned>(thread_count, queries.size()));
+
+	std::vector<std::unique_ptr<ArmorVector>> solutions(queries.size());
+	std::vector<ArmorSolveContext> contexts(queries.size());
+	std::atomic<size_t> next_query(0);
+	std::mutex mutex;
+	std::condition_variable solved;
+
+	auto worker = [&]()
+	{
+		for (size_t i = next_query++; i < queries.size(); i = next_query++)
+		{
+			ArmorSolveContext context;
+			auto solution = solve_armor_query(armors, queries[i], context);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			contexts[i] = context;
+			solutions[i] = std::move(solution);
+			solved.notify_one();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned i = 0; i < thread_count; i++)
+	{
+		workers.emplace_back(worker);
+	}
+
+	for (size_t i = 0; i < queries.size(); i++)
+	{
+		std::unique_ptr<ArmorVector> solution;
+		ArmorSolveContext context;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			solved.wait(lock, [&]() { return solutions[i] != nullptr; });
+			solution = std::move(solutions[i]);
+			context = contexts[i];
+		}
+		visit(i, *solution, context);
+	}
+
+	for (auto& thread : workers)
+	{
+		thread.join();
+	}
+}
@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_bound.hh
+//
+// Upper bounds on the best defense within a budget, and how far a solution
+// from any solver is from them.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+#include "maxtime.hh"
+
+
+// The Dantzig bound: the most defense reachable within total_cost if items
+// could be bought fractionally, which is at least the true optimum.
+// It takes items in decreasing defense / cost order until the next one does
+// not fit, plus the fraction of that one that does. Only the critical ratio
+// where the budget runs out matters, so instead of sorting, it is found by
+// weighted-median selection (Balas and Zemel): partition around the median
+// ratio, keep whichever side the budget runs out in, and repeat on it.
+// Each round is linear in a range at most half as large as the last, so the
+// whole bound is O(n).
+// Items without positive defense never help and are ignored.
+double dantzig_upper_bound(const ArmorVector& armors, double total_cost)
+{
+	struct Entry
+	{
+		double ratio, cost, defense;
+	};
+
+	std::vector<Entry> entries;
+	entries.reserve(armors.size());
+	for (auto& armor : armors)
+	{
+		if (armor->defense() > 0)
+		{
+			entries.push_back({ armor->defense() / armor->cost(), armor->cost(), armor->defense() });
+		}
+	}
+
+	double room = total_cost, gained = 0;
+	if (room <= 0)
+	{
+		return 0;
+	}
+
+	auto lo = entries.begin(), hi = entries.end();
+	while (lo < hi)
+	{
+		auto mid = lo + (hi - lo) / 2;
+		std::nth_element(lo, mid, hi, [](const Entry& a, const Entry& b) { return a.ratio > b.ratio; });
+		const double pivot = mid->ratio;
+
+		// [lo, greater_end) has ratios above the pivot, [greater_end, equal_end)
+		// ratios equal to it, and [equal_end, hi) ratios below it.
+		auto greater_end = std::partition(lo, hi, [pivot](const Entry& e) { return e.ratio > pivot; });
+		auto equal_end = std::partition(greater_end, hi, [pivot](const Entry& e) { return e.ratio == pivot; });
+
+		double greater_cost = 0, greater_defense = 0;
+		for (auto e = lo; e < greater_end; e++)
+		{
+			greater_cost += e->cost;
+			greater_defense += e->defense;
+		}
+		if (greater_cost > room)
+		{
+			hi = greater_end;
+			continue;
+		}
+		room -= greater_cost;
+		gained += greater_defense;
+
+		double equal_cost = 0, equal_defense = 0;
+		for (auto e = greater_end; e < equal_end; e++)
+		{
+			equal_cost += e->cost;
+			equal_defense += e->defense;
+		}
+		if (equal_cost > room)
+		{
+			return gained + pivot * room;
+		}
+		room -= equal_cost;
+		gained += equal_defense;
+		lo = equal_end;
+	}
+
+	// Everything fits.
+	return gained;
+}
+
+
+// How good a solution is, compared with the Dantzig bound of the items it
+// was chosen from.
+struct ArmorSolutionGap
+{
+	double cost = 0, defense = 0;
+
+	double upper_bound = 0;
+
+	// Defense the solution might be missing, at most upper_bound - defense.
+	double absolute() const { return std::max(0.0, upper_bound - defense); }
+
+	// absolute() as a fraction of upper_bound; 0 means provably optimal.
+	double relative() const { return upper_bound > 0 ? absolute() / upper_bound : 0; }
+};
+
+
+// Annotate solution, chosen from candidates within total_cost by any
+// solver, with its optimality gap. O(n) in the number of candidates, so
+// cheaper than every solver it checks.
+ArmorSolutionGap armor_solution_gap
+(
+	const ArmorVector& candidates,
+	double total_cost,
+	const ArmorVector& solution
+)
+{
+	ArmorSolutionGap gap;
+	sum_armor_vector(solution, gap.cost, gap.defense);
+	gap.upper_bound = dantzig_upper_bound(candidates, total_cost);
+	return gap;
+}
@@ -0,0 +1,262 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_catalogue.hh
+//
+// A loaded armor catalogue that knows the defense / cost order of its items,
+// and filtered views of it that inherit that order, so greedy solves on any
+// filter result need no sort; and a greedy solver that keeps that order
+// while items are appended.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "armor_generic.hh"
+#include "maxtime.hh"
+
+
+// An armor catalogue plus the permutation of its items by decreasing
+// defense / cost ratio, computed once when the catalogue is built. Ties keep
+// catalogue order, which is the order greedy_max_defense breaks them in.
+class ArmorCatalogue
+{
+	//
+	public:
+
+		//
+		explicit ArmorCatalogue(std::shared_ptr<const ArmorVector> armors)
+			:
+			_armors(armors),
+			_by_ratio(armors->size()),
+			_ratio_rank(armors->size())
+		{
+			const ArmorVector& items = *_armors;
+			for (size_t i = 0; i < items.size(); i++)
+			{
+				_by_ratio[i] = i;
+			}
+			std::stable_sort(
+				_by_ratio.begin(), _by_ratio.end(),
+				[&](uint32_t a, uint32_t b)
+				{
+					return items[a]->defense() / items[a]->cost() > items[b]->defense() / items[b]->cost();
+				}
+			);
+			for (size_t k = 0; k < _by_ratio.size(); k++)
+			{
+				_ratio_rank[_by_ratio[k]] = k;
+			}
+		}
+
+		const ArmorVector& armors() const { return *_armors; }
+
+		size_t size() const { return _armors->size(); }
+
+		// Item indexes in decreasing ratio order.
+		const std::vector<uint32_t>& by_ratio() const { return _by_ratio; }
+
+		// Position of item i in by_ratio().
+		uint32_t ratio_rank(size_t i) const { return _ratio_rank[i]; }
+
+	//
+	private:
+
+		std::shared_ptr<const ArmorVector> _armors;
+		std::vector<uint32_t> _by_ratio, _ratio_rank;
+};
+
+
+// Load an armor database as a catalogue; see load_armor_database.
+// Returns nullptr on I/O error.
+std::unique_ptr<ArmorCatalogue> load_armor_catalogue(const std::string& path)
+{
+	std::shared_ptr<const ArmorVector> armors(load_armor_database(path));
+	if ( ! armors )
+	{
+		return std::unique_ptr<ArmorCatalogue>(nullptr);
+	}
+	return std::unique_ptr<ArmorCatalogue>(new ArmorCatalogue(armors));
+}
+
+
+// A subset of a catalogue's items, by index, in catalogue order and in
+// decreasing ratio order. Only valid alongside the catalogue it came from.
+struct ArmorView
+{
+	std::vector<uint32_t> items;
+	std::vector<uint32_t> by_ratio;
+
+	size_t size() const { return items.size(); }
+};
+
+
+// Fill in view.by_ratio from view.items by selecting the subsequence of the
+// catalogue's ratio order that is in the view. That walk is linear in the
+// catalogue, so views much smaller than it sort their ratio ranks instead.
+void order_armor_view(const ArmorCatalogue& catalogue, ArmorView& view)
+{
+	const size_t k = view.items.size(), n = catalogue.size();
+	view.by_ratio.clear();
+	view.by_ratio.reserve(k);
+
+	if (k * std::log2(k + 2.0) < n)
+	{
+		std::vector<uint32_t> ranks;
+		ranks.reserve(k);
+		for (uint32_t i : view.items)
+		{
+			ranks.push_back(catalogue.ratio_rank(i));
+		}
+		std::sort(ranks.begin(), ranks.end());
+		for (uint32_t rank : ranks)
+		{
+			view.by_ratio.push_back(catalogue.by_ratio()[rank]);
+		}
+		return;
+	}
+
+	std::vector<char> in_view(n, 0);
+	for (uint32_t i : view.items)
+	{
+		in_view[i] = 1;
+	}
+	for (uint32_t i : catalogue.by_ratio())
+	{
+		if (in_view[i])
+		{
+			view.by_ratio.push_back(i);
+		}
+	}
+}
+
+
+// filter_armor_vector over a catalogue, returning a view that shares the
+// catalogue's items instead of copying them.
+ArmorView filter_armor_catalogue
+(
+	const ArmorCatalogue& catalogue,
+	double min_defense,
+	double max_defense,
+	int total_size
+)
+{
+	ArmorView view;
+	const ArmorVector& armors = catalogue.armors();
+	for (size_t i = 0; i < armors.size() && int(view.items.size()) < total_size; i++)
+	{
+		if (armor_matches_filter(*armors[i], min_defense, max_defense))
+		{
+			view.items.push_back(i);
+		}
+	}
+	order_armor_view(catalogue, view);
+	return view;
+}
+
+
+// The items of view, in catalogue order, for the solvers that take an
+// ArmorVector.
+std::unique_ptr<ArmorVector> armor_view_vector(const ArmorCatalogue& catalogue, const ArmorView& view)
+{
+	std::unique_ptr<ArmorVector> output(new ArmorVector);
+	output->reserve(view.size());
+	for (uint32_t i : view.items)
+	{
+		output->push_back(catalogue.armors()[i]);
+	}
+	return output;
+}
+
+
+// greedy_max_defense on a view, as one linear pass over its ratio order:
+// the same items in the same order, without the search for the next best
+// ratio.
+std::unique_ptr<ArmorVector> greedy_max_defense_view
+(
+	const ArmorCatalogue& catalogue,
+	const ArmorView& view,
+	double total_cost
+)
+{
+	const ArmorVector& armors = catalogue.armors();
+	return armor_indexes_vector(armors, greedy_fit_generic<double>(ArmorVectorAccess{ armors }, view.by_ratio, total_cost));
+}
+
+
+// Items of a filtered view, in catalogue order, as an access policy for
+// armor_generic.hh.
+struct ArmorViewAccess
+{
+	const ArmorCatalogue& catalogue;
+	const ArmorView& view;
+
+	size_t size() const { return view.items.size(); }
+	double cost(size_t i) const { return catalogue.armors()[view.items[i]]->cost(); }
+	double defense(size_t i) const { return catalogue.armors()[view.items[i]]->defense(); }
+};
+
+
+// greedy_max_defense over a growing prefix of items. Appended items are
+// sorted among themselves and merged into the ratio order kept so far, so
+// each solve is a linear pass; answering every prefix of a sweep like
+// maxtime_main's costs about as much as one greedy_max_defense on the
+// largest prefix, with no quadratic search.
+class ArmorPrefixGreedy
+{
+	//
+	public:
+
+		// Append items after those already added.
+		void append(const ArmorVector& armors)
+		{
+			size_t old_size = _by_ratio.size();
+			for (auto& armor : armors)
+			{
+				_by_ratio.push_back({ armor->defense() / armor->cost(), armor });
+			}
+
+			// Stable: equal ratios keep append order, as greedy_max_defense does.
+			auto greater_ratio = [](const Entry& a, const Entry& b) { return a.ratio > b.ratio; };
+			std::stable_sort(_by_ratio.begin() + old_size, _by_ratio.end(), greater_ratio);
+			std::inplace_merge(_by_ratio.begin(), _by_ratio.begin() + old_size, _by_ratio.end(), greater_ratio);
+		}
+
+		// Number of items appended so far.
+		size_t size() const { return _by_ratio.size(); }
+
+		// greedy_max_defense of every item appended so far.
+		std::unique_ptr<ArmorVector> solve(double total_cost) const
+		{
+			std::unique_ptr<ArmorVector> output(new ArmorVector);
+			double current_cost = 0.0;
+			for (auto& entry : _by_ratio)
+			{
+				if (current_cost + entry.armor->cost() <= total_cost)
+				{
+					current_cost += entry.armor->cost();
+					output->push_back(entry.armor);
+				}
+			}
+			return output;
+		}
+
+	//
+	private:
+
+		struct Entry
+		{
+			double ratio;
+			std::shared_ptr<ArmorItem> armor;
+		};
+
+		std::vector<Entry> _by_ratio;
+};
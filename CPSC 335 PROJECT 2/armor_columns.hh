@@ -0,0 +1,362 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_columns.hh
+//
+// Column-oriented copies of an ArmorVector's costs and defenses, and filter,
+// greedy and exhaustive kernels over them that can run in float to halve
+// memory traffic and double the SIMD lanes, with the answer re-verified
+// against the exact double values. Optional 16-bit quantised columns serve
+// as an even narrower conservative pre-filter.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+#include "armor_generic.hh"
+#include "maxtime.hh"
+
+
+// The costs and defenses of an ArmorVector stored as two contiguous arrays
+// of T (float or double), parallel to the vector they were made from.
+template <typename T>
+struct ArmorColumns
+{
+	std::vector<T> cost;
+	std::vector<T> defense;
+
+	size_t size() const { return cost.size(); }
+};
+
+
+// Items of ArmorColumns<T>, as an access policy for armor_generic.hh.
+template <typename T>
+struct ArmorColumnsAccess
+{
+	const ArmorColumns<T>& columns;
+
+	size_t size() const { return columns.size(); }
+	T cost(size_t i) const { return columns.cost[i]; }
+	T defense(size_t i) const { return columns.defense[i]; }
+};
+
+
+//
+template <typename T>
+ArmorColumns<T> make_armor_columns(const ArmorVector& armors)
+{
+	ArmorColumns<T> columns;
+	columns.cost.reserve(armors.size());
+	columns.defense.reserve(armors.size());
+	for (auto& armor : armors)
+	{
+		columns.cost.push_back(T(armor->cost()));
+		columns.defense.push_back(T(armor->defense()));
+	}
+	return columns;
+}
+
+
+// True when the total cost of armors, summed in double, is within total_cost.
+bool armor_solution_fits(const ArmorVector& armors, double total_cost)
+{
+	double cost, defense;
+	sum_armor_vector(armors, cost, defense);
+	return cost <= total_cost;
+}
+
+
+// Call visit(i) for each i below count whose flags[i] is non-zero, in
+// order, skipping runs of zero flags eight bytes at a time. Stops early when
+// visit returns false.
+template <typename Visitor>
+void for_each_flagged(const uint8_t* flags, size_t count, Visitor visit)
+{
+	size_t i = 0;
+	while (i < count)
+	{
+		uint64_t word = 0;
+		if (i + sizeof(word) <= count)
+		{
+			std::memcpy(&word, flags + i, sizeof(word));
+			if (word == 0)
+			{
+				i += sizeof(word);
+				continue;
+			}
+		}
+
+		size_t end = std::min(i + sizeof(word), count);
+		for (; i < end; i++)
+		{
+			if (flags[i] && ! visit(i))
+			{
+				return;
+			}
+		}
+	}
+}
+
+
+// filter_armor_vector over columns, which must have been made from armors.
+// Rows are first compared in T against bounds widened by one ulp, a loop the
+// compiler vectorises, and only those candidates are rechecked against the
+// exact double values, so the result is always identical to
+// filter_armor_vector. Matching items are shared with armors, not copied.
+template <typename T>
+std::unique_ptr<ArmorVector> filter_armor_columns
+(
+	const ArmorColumns<T>& columns,
+	const ArmorVector& armors,
+	double min_defense,
+	double max_defense,
+	int total_size
+)
+{
+	assert(columns.size() == armors.size());
+
+	std::unique_ptr<ArmorVector> output(new ArmorVector);
+
+	const T
+		low = std::nextafter(std::max(T(min_defense), T(0)), -std::numeric_limits<T>::infinity()),
+		high = std::nextafter(T(max_defense), std::numeric_limits<T>::infinity())
+		;
+
+	const size_t block = 1024;
+	uint8_t candidate[block];
+
+	for (size_t start = 0; start < columns.size() && int(output->size()) < total_size; start += block)
+	{
+		size_t end = std::min(start + block, columns.size());
+		const T* defense = columns.defense.data() + start;
+
+		for (size_t i = 0; i < end - start; i++)
+		{
+			candidate[i] = (defense[i] >= low) & (defense[i] <= high);
+		}
+
+		for_each_flagged(
+			candidate, end - start,
+			[&](size_t i)
+			{
+				if (armor_matches_filter(*armors[start + i], min_defense, max_defense))
+				{
+					output->push_back(armors[start + i]);
+				}
+				return int(output->size()) < total_size;
+			}
+		);
+	}
+
+	return output;
+}
+
+
+// greedy_max_defense over columns, which must have been made from armors.
+// The defense / cost ordering is computed and sorted in T; the running cost
+// is kept in double over armors so the result never exceeds total_cost.
+// Ties keep input order, as in greedy_max_defense, but in float two ratios
+// closer than float precision count as tied.
+template <typename T>
+std::unique_ptr<ArmorVector> greedy_max_defense_columns
+(
+	const ArmorColumns<T>& columns,
+	const ArmorVector& armors,
+	double total_cost
+)
+{
+	assert(columns.size() == armors.size());
+
+	auto order = armor_ratio_order(ArmorColumnsAccess<T>{ columns });
+	return armor_indexes_vector(armors, greedy_fit_generic<double>(ArmorVectorAccess{ armors }, order, total_cost));
+}
+
+
+// One column quantised to 16 bits: each value v is stored as the bucket
+// q = floor((v - offset) / step), clamped to 0..65535, so v lies in about
+// [offset + q * step, offset + (q + 1) * step).
+struct ArmorQuantizedColumn
+{
+	double offset = 0, step = 1;
+	std::vector<uint16_t> bucket;
+
+	// Bucket of value, without clamping; may be outside 0..65535.
+	int64_t bucket_of(double value) const
+	{
+		double q = std::floor((value - offset) / step);
+		return int64_t(std::max(-1e9, std::min(1e9, q)));
+	}
+};
+
+
+//
+ArmorQuantizedColumn make_armor_quantized_column(const std::vector<double>& values)
+{
+	ArmorQuantizedColumn column;
+	if (values.empty())
+	{
+		return column;
+	}
+
+	auto range = std::minmax_element(values.begin(), values.end());
+	column.offset = *range.first;
+	column.step = *range.second > *range.first ? (*range.second - *range.first) / 65535 : 1;
+
+	column.bucket.reserve(values.size());
+	for (double value : values)
+	{
+		column.bucket.push_back(uint16_t(std::max<int64_t>(0, std::min<int64_t>(65535, column.bucket_of(value)))));
+	}
+	return column;
+}
+
+
+// Optional 16-bit quantised cost and defense columns of an ArmorVector,
+// a quarter the size of the doubles, for conservative first-pass filtering.
+struct ArmorQuantizedColumns
+{
+	ArmorQuantizedColumn cost, defense;
+
+	size_t size() const { return defense.bucket.size(); }
+};
+
+
+//
+ArmorQuantizedColumns make_armor_quantized_columns(const ArmorVector& armors)
+{
+	std::vector<double> cost, defense;
+	cost.reserve(armors.size());
+	defense.reserve(armors.size());
+	for (auto& armor : armors)
+	{
+		cost.push_back(armor->cost());
+		defense.push_back(armor->defense());
+	}
+
+	ArmorQuantizedColumns columns;
+	columns.cost = make_armor_quantized_column(cost);
+	columns.defense = make_armor_quantized_column(defense);
+	return columns;
+}
+
+
+// filter_armor_vector over quantised columns made from armors, optionally
+// also dropping items that cost more than max_cost.
+// Each row's 16-bit buckets are compared against the threshold buckets in a
+// branch-free loop (8 lanes per SSE2 register). Rows whose buckets are well
+// inside the range are accepted and rows well outside it rejected without
+// touching the items; only rows within a bucket or so of a threshold are
+// rechecked against the exact values. The result is always identical to
+// filter_armor_vector with a cost limit. Matching items are shared with
+// armors, not copied.
+std::unique_ptr<ArmorVector> filter_armor_quantized
+(
+	const ArmorQuantizedColumns& columns,
+	const ArmorVector& armors,
+	double min_defense,
+	double max_defense,
+	int total_size,
+	double max_cost = INFINITY
+)
+{
+	assert(columns.size() == armors.size());
+
+	std::unique_ptr<ArmorVector> output(new ArmorVector);
+
+	// Rounding in bucket_of can move a value into a neighbouring bucket, so
+	// the buckets either side of a threshold's own are uncertain too.
+	const int64_t
+		defense_low = columns.defense.bucket_of(std::max(min_defense, 0.0)),
+		defense_high = columns.defense.bucket_of(max_defense),
+		cost_high = std::isinf(max_cost) ? 65537 : columns.cost.bucket_of(max_cost)
+		;
+
+	// Inclusive bucket bounds for candidates and for certain matches, as
+	// uint16_t so the comparisons run in 16-bit lanes. An empty range is
+	// encoded as low 65535, high 0 (nothing is both >= 65535 and <= 0 once
+	// the buckets at the ends are treated as uncertain).
+	auto bound = [](int64_t q) { return uint16_t(std::max<int64_t>(0, std::min<int64_t>(65535, q))); };
+	if (defense_low - 1 > 65535 || defense_high + 1 < 0 || cost_high + 1 < 0)
+	{
+		return output;
+	}
+	const uint16_t
+		candidate_low = bound(defense_low - 1),
+		candidate_high = bound(defense_high + 1),
+		candidate_cost = bound(cost_high + 1)
+		;
+	bool any_certain = defense_low + 2 <= 65535 && defense_high - 2 >= 0 && cost_high - 2 >= 0;
+	const uint16_t
+		certain_low = any_certain ? bound(defense_low + 2) : 65535,
+		certain_high = any_certain ? bound(defense_high - 2) : 0,
+		certain_cost = any_certain ? bound(cost_high - 2) : 0
+		;
+
+	const size_t block = 1024;
+
+	// Per row: 0 rejected, 1 needs an exact recheck, 3 accepted.
+	uint8_t state[block];
+
+	for (size_t start = 0; start < columns.size() && int(output->size()) < total_size; start += block)
+	{
+		size_t end = std::min(start + block, columns.size());
+		const uint16_t* defense = columns.defense.bucket.data() + start;
+		const uint16_t* cost = columns.cost.bucket.data() + start;
+
+		for (size_t i = 0; i < end - start; i++)
+		{
+			uint16_t d = defense[i], c = cost[i];
+			uint8_t candidate = (d >= candidate_low) & (d <= candidate_high) & (c <= candidate_cost);
+			uint8_t certain = (d >= certain_low) & (d <= certain_high) & (c <= certain_cost);
+			state[i] = candidate | (certain << 1);
+		}
+
+		for_each_flagged(
+			state, end - start,
+			[&](size_t i)
+			{
+				if (state[i] == 3
+					|| (armor_matches_filter(*armors[start + i], min_defense, max_defense)
+						&& armors[start + i]->cost() <= max_cost))
+				{
+					output->push_back(armors[start + i]);
+				}
+				return int(output->size()) < total_size;
+			}
+		);
+	}
+
+	return output;
+}
+
+
+// exhaustive_max_defense over columns, which must have been made from armors:
+// exhaustive_max_defense_generic in T, with the subsets near the budget
+// re-verified against armors in double, so the result always fits and in
+// float is optimal to within float precision. Requires fewer than 64 items.
+template <typename T>
+std::unique_ptr<ArmorVector> exhaustive_max_defense_columns
+(
+	const ArmorColumns<T>& columns,
+	const ArmorVector& armors,
+	double total_cost
+)
+{
+	assert(columns.size() == armors.size());
+
+	return armor_indexes_vector(
+		armors,
+		exhaustive_max_defense_generic<T>(ArmorColumnsAccess<T>{ columns }, total_cost, ArmorVectorAccess{ armors })
+	);
+}
@@ -0,0 +1,470 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_delta.hh
+//
+// Append-only delta log of catalogue updates, applied on top of a base
+// database at load time and folded into a new snapshot by compaction.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "maxtime.hh"
+
+
+// Kinds of catalogue update.
+enum class ArmorDeltaOp : uint8_t
+{
+	add = 1,		// add an item, or replace the item with the same description
+	remove = 2,		// remove the item with this description
+	set_cost = 3,		// change the cost of an existing item
+	set_defense = 4		// change the defense of an existing item
+};
+
+
+// One catalogue update. Items are identified by their description, which is
+// unique in the catalogue. Only the fields the op needs are used.
+struct ArmorDelta
+{
+	ArmorDeltaOp op;
+	std::string description;
+	double cost;
+	double defense;
+};
+
+
+// Magic bytes at the start of a delta log.
+// After the magic comes the path of the base database the log applies to, as
+// a uint32_t length and the path bytes. Each record is then a uint8_t op, a
+// uint32_t description length, the description bytes, and the cost and
+// defense as doubles, in host byte order.
+const char ARMOR_DELTA_MAGIC[8] = { 'A', 'R', 'M', 'O', 'R', 'D', 'L', '2' };
+
+
+// Append the magic and base path that start a delta log to bytes.
+void encode_armor_delta_header(const std::string& base_path, std::string& bytes)
+{
+	uint32_t length = base_path.size();
+	bytes.append(ARMOR_DELTA_MAGIC, sizeof(ARMOR_DELTA_MAGIC));
+	bytes.append(reinterpret_cast<const char*>(&length), sizeof(length));
+	bytes.append(base_path);
+}
+
+
+// Encode one delta as a log record and append it to bytes.
+void encode_armor_delta(const ArmorDelta& delta, std::string& bytes)
+{
+	uint8_t op = static_cast<uint8_t>(delta.op);
+	uint32_t length = delta.description.size();
+	bytes.append(reinterpret_cast<const char*>(&op), sizeof(op));
+	bytes.append(reinterpret_cast<const char*>(&length), sizeof(length));
+	bytes.append(delta.description);
+	bytes.append(reinterpret_cast<const char*>(&delta.cost), sizeof(delta.cost));
+	bytes.append(reinterpret_cast<const char*>(&delta.defense), sizeof(delta.defense));
+}
+
+
+// Decode a delta log: the base path from its header, and its records.
+// A partial record at the end, left by an append that was interrupted, is
+// ignored. Returns the number of bytes of the header and complete records,
+// or 0 if the header is missing or a record is invalid.
+size_t decode_armor_deltas(const std::string& bytes, std::string& base_path, std::vector<ArmorDelta>& deltas)
+{
+	const size_t magic_size = sizeof(ARMOR_DELTA_MAGIC);
+	if (bytes.size() < magic_size + sizeof(uint32_t) || bytes.compare(0, magic_size, ARMOR_DELTA_MAGIC, magic_size) != 0)
+	{
+		return 0;
+	}
+
+	uint32_t path_length;
+	std::memcpy(&path_length, &bytes[magic_size], sizeof(path_length));
+	if (bytes.size() - magic_size - sizeof(path_length) < path_length)
+	{
+		return 0;
+	}
+	base_path.assign(bytes, magic_size + sizeof(path_length), path_length);
+
+	const size_t fixed_size = sizeof(uint8_t) + sizeof(uint32_t) + 2 * sizeof(double);
+	size_t offset = magic_size + sizeof(path_length) + path_length;
+	while (bytes.size() - offset >= fixed_size)
+	{
+		uint8_t op;
+		uint32_t length;
+		std::memcpy(&op, &bytes[offset], sizeof(op));
+		std::memcpy(&length, &bytes[offset + sizeof(op)], sizeof(length));
+		if (bytes.size() - offset < fixed_size + length)
+		{
+			break;
+		}
+		if (op < 1 || op > 4)
+		{
+			return 0;
+		}
+
+		ArmorDelta delta;
+		size_t position = offset + sizeof(op) + sizeof(length);
+		delta.op = static_cast<ArmorDeltaOp>(op);
+		delta.description.assign(bytes, position, length);
+		position += length;
+		std::memcpy(&delta.cost, &bytes[position], sizeof(delta.cost));
+		std::memcpy(&delta.defense, &bytes[position + sizeof(delta.cost)], sizeof(delta.defense));
+		deltas.push_back(delta);
+
+		offset += fixed_size + length;
+	}
+
+	return offset;
+}
+
+
+// Apply deltas, in order, to armors. Item order is preserved; added items go
+// at the end. Changed items are replaced by new ArmorItem objects, so
+// solutions that share the old ones are unaffected.
+// Returns the descriptions of every item that was added, removed or changed,
+// so callers that cache per-item results only need to drop those entries.
+std::set<std::string> apply_armor_deltas(ArmorVector& armors, const std::vector<ArmorDelta>& deltas)
+{
+	std::set<std::string> touched;
+	if (deltas.empty())
+	{
+		return touched;
+	}
+
+	std::unordered_map<std::string, size_t> position;
+	for (size_t i = 0; i < armors.size(); i++)
+	{
+		position[armors[i]->description()] = i;
+	}
+
+	for (auto& delta : deltas)
+	{
+		auto found = position.find(delta.description);
+		bool exists = found != position.end();
+
+		switch (delta.op)
+		{
+			case ArmorDeltaOp::add:
+			{
+				std::shared_ptr<ArmorItem> armor(new ArmorItem(delta.description, delta.cost, delta.defense));
+				if (exists)
+				{
+					armors[found->second] = armor;
+				}
+				else
+				{
+					position[delta.description] = armors.size();
+					armors.push_back(armor);
+				}
+				break;
+			}
+
+			case ArmorDeltaOp::remove:
+				if (exists)
+				{
+					// Removed slots are compacted away below.
+					armors[found->second] = nullptr;
+					position.erase(found);
+				}
+				break;
+
+			case ArmorDeltaOp::set_cost:
+			case ArmorDeltaOp::set_defense:
+				if (exists)
+				{
+					auto& armor = armors[found->second];
+					armor = std::shared_ptr<ArmorItem>(
+						new ArmorItem(
+							armor->description(),
+							delta.op == ArmorDeltaOp::set_cost ? delta.cost : armor->cost(),
+							delta.op == ArmorDeltaOp::set_defense ? delta.defense : armor->defense()
+						)
+					);
+				}
+				break;
+		}
+
+		if (exists || delta.op == ArmorDeltaOp::add)
+		{
+			touched.insert(delta.description);
+		}
+	}
+
+	armors.erase(std::remove(armors.begin(), armors.end(), nullptr), armors.end());
+
+	return touched;
+}
+
+
+// A base armor database plus an append-only log of updates to it.
+// Updates are cheap appends instead of rewriting the whole CSV; load applies
+// the log on top of the base, and compaction folds the log into a new
+// snapshot in the background and becomes the new base.
+// The log names its base in its header, and compaction switches both with
+// one atomic rename of the rewritten log, so a restarted process, or a
+// crash at any point, sees either the old base with every record or the new
+// snapshot with only the records it lacks.
+// Safe to use from several threads of one process; compactions run one at
+// a time, and the log must not be written by other processes while one
+// runs.
+class ArmorDeltaLog
+{
+	//
+	public:
+
+		// base_path is any database load_armor_database accepts, and is
+		// recorded in the log when the log is created; log_path need not
+		// exist yet. If it does, the base it names wins over base_path,
+		// since after a compaction that is the one its records apply to.
+		ArmorDeltaLog
+		(
+			const std::string& base_path,
+			const std::string& log_path
+		)
+			:
+			_base_path(base_path),
+			_log_path(log_path)
+		{
+			std::string log_bytes;
+			std::vector<ArmorDelta> deltas;
+			if (read_log(log_bytes) && ! log_bytes.empty())
+			{
+				decode_armor_deltas(log_bytes, _base_path, deltas);
+			}
+		}
+
+		// Append one update to the log.
+		// Returns false on I/O error, or if the update would create an item
+		// ArmorItem rejects (empty description or non-positive cost).
+		bool append(const ArmorDelta& delta)
+		{
+			bool sets_cost = delta.op == ArmorDeltaOp::add || delta.op == ArmorDeltaOp::set_cost;
+			if (delta.description.empty() || (sets_cost && ! (delta.cost > 0)))
+			{
+				std::cout << "Invalid armor delta for item: " << delta.description << std::endl;
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			std::string record;
+			if ( ! std::ifstream(_log_path) )
+			{
+				encode_armor_delta_header(_base_path, record);
+			}
+			encode_armor_delta(delta, record);
+
+			std::ofstream f(_log_path, std::ios::binary | std::ios::app);
+			f.write(record.data(), record.size());
+			f.flush();
+			if (!f)
+			{
+				std::cout << "Failed to append armor delta; Cannot write file: " << _log_path << std::endl;
+				return false;
+			}
+			return true;
+		}
+
+		// Load the base database and apply the logged updates.
+		// If touched is not null it receives the descriptions of the items the
+		// log changed relative to the base.
+		// Returns nullptr on I/O error or a corrupt log.
+		std::unique_ptr<ArmorVector> load(std::set<std::string>* touched = nullptr)
+		{
+			// No compaction may publish between reading the log and its base.
+			std::shared_lock<std::shared_mutex> reading(_publish_mutex);
+
+			std::string base_path, log_bytes;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				base_path = _base_path;
+				if ( ! read_log(log_bytes) )
+				{
+					return std::unique_ptr<ArmorVector>(nullptr);
+				}
+			}
+
+			std::vector<ArmorDelta> deltas;
+			if ( ! log_bytes.empty() && decode_armor_deltas(log_bytes, base_path, deltas) == 0 )
+			{
+				std::cout << "Failed to load armor deltas; Corrupt file: " << _log_path << std::endl;
+				return std::unique_ptr<ArmorVector>(nullptr);
+			}
+
+			auto armors = load_armor_database(base_path);
+			if ( ! armors )
+			{
+				return armors;
+			}
+
+			auto changed = apply_armor_deltas(*armors, deltas);
+			if (touched)
+			{
+				*touched = changed;
+			}
+			return armors;
+		}
+
+		// Fold the log into a new binary snapshot at snapshot_path, which then
+		// becomes the base, and drop the folded records from the log.
+		// Updates appended while compaction runs are kept in the log.
+		// The catalogue contents do not change, so no cache needs invalidating.
+		// A compaction started while another runs waits for it, then folds
+		// what that one left in the log.
+		// snapshot_path must not be the current base: overwriting it could
+		// not be made atomic with the log rewrite.
+		// Returns false on I/O error, or if snapshot_path is the current base.
+		bool compact(const std::string& snapshot_path)
+		{
+			// The log is rewritten at an offset into the version read below,
+			// so no other compaction may rewrite it in between.
+			std::lock_guard<std::mutex> compacting(_compact_mutex);
+
+			std::string base_path, log_bytes;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				base_path = _base_path;
+				if ( ! read_log(log_bytes) )
+				{
+					return false;
+				}
+			}
+
+			std::vector<ArmorDelta> deltas;
+			size_t folded = log_bytes.empty() ? 0 : decode_armor_deltas(log_bytes, base_path, deltas);
+			if ( ! log_bytes.empty() && folded == 0 )
+			{
+				std::cout << "Failed to compact armor deltas; Corrupt file: " << _log_path << std::endl;
+				return false;
+			}
+			if (snapshot_path == base_path)
+			{
+				std::cout << "Failed to compact armor deltas; Snapshot would replace the base in use: " << base_path << std::endl;
+				return false;
+			}
+
+			auto armors = load_armor_database(base_path);
+			if ( ! armors )
+			{
+				return false;
+			}
+			apply_armor_deltas(*armors, deltas);
+
+			const std::string snapshot_temp = snapshot_path + ".tmp";
+			if ( ! save_armor_snapshot(*armors, snapshot_temp) )
+			{
+				std::remove(snapshot_temp.c_str());
+				return false;
+			}
+
+			// Publish: no load may be between reading the log and its base,
+			// and no append may be writing the log.
+			std::unique_lock<std::shared_mutex> publishing(_publish_mutex);
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			// Keep whatever was appended after the log was read above.
+			std::string current;
+			if ( ! read_log(current) )
+			{
+				std::remove(snapshot_temp.c_str());
+				return false;
+			}
+			// A log created by an append since then starts with the same
+			// base, which only compaction changes.
+			std::string remaining;
+			encode_armor_delta_header(snapshot_path, remaining);
+			size_t keep_from = folded;
+			if (keep_from == 0)
+			{
+				std::string header;
+				encode_armor_delta_header(base_path, header);
+				keep_from = header.size();
+			}
+			if (current.size() > keep_from)
+			{
+				remaining.append(current, keep_from, std::string::npos);
+			}
+
+			const std::string log_temp = _log_path + ".tmp";
+			{
+				std::ofstream f(log_temp, std::ios::binary | std::ios::trunc);
+				f.write(remaining.data(), remaining.size());
+				if (!f)
+				{
+					std::remove(snapshot_temp.c_str());
+					return false;
+				}
+			}
+
+			// The snapshot is not yet anyone's base, so renaming it first
+			// leaves the old base and full log in force until the log's
+			// rename switches both.
+			if (std::rename(snapshot_temp.c_str(), snapshot_path.c_str()) != 0
+				|| std::rename(log_temp.c_str(), _log_path.c_str()) != 0)
+			{
+				std::remove(snapshot_temp.c_str());
+				std::remove(log_temp.c_str());
+				return false;
+			}
+
+			_base_path = snapshot_path;
+			return true;
+		}
+
+		// Run compact on a background thread.
+		std::future<bool> compact_async(const std::string& snapshot_path)
+		{
+			return std::async(std::launch::async, [this, snapshot_path]() { return compact(snapshot_path); });
+		}
+
+		// The database the log currently applies to.
+		std::string base_path()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _base_path;
+		}
+
+	//
+	private:
+
+		// Read the whole log into bytes; a missing log reads as empty.
+		// Call with _mutex held, or from the constructor.
+		bool read_log(std::string& bytes)
+		{
+			bytes.clear();
+			std::ifstream f(_log_path, std::ios::binary);
+			if (!f)
+			{
+				return true;
+			}
+			bytes.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+			return ! f.bad();
+		}
+
+		std::string _base_path, _log_path;
+
+		// _mutex guards the paths and each read or write of the log;
+		// _compact_mutex is held for a whole compaction, and taken first.
+		std::mutex _mutex, _compact_mutex;
+
+		// Shared by a load while it reads the log and then the base it names;
+		// held exclusively while compaction switches the base. Taken before
+		// _mutex.
+		std::shared_mutex _publish_mutex;
+};
@@ -0,0 +1,487 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_dp.hh
+//
+// Dynamic programming solvers over the budget scaled to integers.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "armor_generic.hh"
+#include "armor_profile.hh"
+#include "maxtime.hh"
+
+
+// Factor that turns the costs of an access policy's items into integers:
+// 10 to the largest number of decimal places any cost uses, at most 6.
+// ride.csv is priced in cents, so its scale is 100.
+// A cost that needs more places, like 1 / 3, is left out rather than
+// pushing the scale and every table sized by it to 10^6; the integer
+// solvers round it up, and armor_costs_exact reports it.
+template <typename Access>
+int64_t armor_cost_scale(const Access& access)
+{
+	int decimals = 0;
+	for (size_t i = 0; i < access.size(); i++)
+	{
+		const double cost = double(access.cost(i));
+		const int places = armor_decimal_places(cost);
+		if (places < 6 || armor_scales_exactly(cost, 1000000))
+		{
+			decimals = std::max(decimals, places);
+		}
+	}
+	int64_t scale = 1;
+	for (int i = 0; i < decimals; i++)
+	{
+		scale *= 10;
+	}
+	return scale;
+}
+
+
+//
+int64_t armor_cost_scale(const ArmorVector& armors)
+{
+	return armor_cost_scale(ArmorVectorAccess{ armors });
+}
+
+
+// True when every cost is a whole number of 1 / armor_cost_scale units, so
+// the integer solvers that use that scale are exact.
+template <typename Access>
+bool armor_costs_exact(const Access& access)
+{
+	const int64_t scale = armor_cost_scale(access);
+	for (size_t i = 0; i < access.size(); i++)
+	{
+		if ( ! armor_scales_exactly(double(access.cost(i)), scale) )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+//
+bool armor_costs_exact(const ArmorVector& armors)
+{
+	return armor_costs_exact(ArmorVectorAccess{ armors });
+}
+
+
+// Upgrades that may only be bought together with their base item:
+// dependencies[i] is the index of the item armors[i] requires, -1, or
+// ARMOR_UNAVAILABLE_BASE if its base item is not in armors at all.
+// Each item requires at most one other, and there are no cycles, so the
+// items form a forest with base items as parents of their upgrades.
+// An empty ArmorDependencies means no item requires another.
+typedef std::vector<int> ArmorDependencies;
+
+
+// Requirement of an upgrade whose base item cannot be bought, so neither
+// can the upgrade. Such an item is a root of the forest that is never taken.
+const int ARMOR_UNAVAILABLE_BASE = -2;
+
+
+// The base item armors[i] requires, -1, or ARMOR_UNAVAILABLE_BASE.
+int armor_requirement_of(const ArmorDependencies& dependencies, size_t i)
+{
+	return i < dependencies.size() ? dependencies[i] : -1;
+}
+
+
+// True when no item requires another, so the forest is all roots.
+bool armor_dependencies_none(const ArmorDependencies& dependencies)
+{
+	return std::all_of(dependencies.begin(), dependencies.end(), [](int parent) { return parent == -1; });
+}
+
+
+// Items of the forest in depth-first preorder, so every subtree is a
+// contiguous range: the subtree of order[k] ends before order[next[k]].
+// Returns false if dependencies contain a cycle.
+bool armor_dependency_preorder
+(
+	const ArmorDependencies& dependencies,
+	size_t n,
+	std::vector<uint32_t>& order,
+	std::vector<uint32_t>& next
+)
+{
+	std::vector<std::vector<uint32_t>> children(n);
+	std::vector<uint32_t> roots;
+	for (size_t i = 0; i < n; i++)
+	{
+		int parent = armor_requirement_of(dependencies, i);
+		assert(parent < int(n));
+		if (parent < 0)
+		{
+			roots.push_back(i);
+		}
+		else
+		{
+			children[parent].push_back(i);
+		}
+	}
+
+	order.clear();
+	next.assign(n, 0);
+	std::vector<uint32_t> position(n);
+	std::vector<uint32_t> stack(roots.rbegin(), roots.rend());
+	while ( ! stack.empty() )
+	{
+		uint32_t item = stack.back();
+		stack.pop_back();
+		position[item] = order.size();
+		order.push_back(item);
+		stack.insert(stack.end(), children[item].rbegin(), children[item].rend());
+	}
+
+	// Items on a cycle are never reached from a root.
+	if (order.size() != n)
+	{
+		return false;
+	}
+
+	// Subtree sizes, children before parents.
+	std::vector<uint32_t> size(n, 1);
+	for (size_t k = n; k-- > 0; )
+	{
+		int parent = armor_requirement_of(dependencies, order[k]);
+		if (parent >= 0)
+		{
+			size[parent] += size[order[k]];
+		}
+	}
+	for (size_t k = 0; k < n; k++)
+	{
+		next[k] = k + size[order[k]];
+	}
+	return true;
+}
+
+
+// Load a dependency forest for armors.
+// Like the armor database the file is '^'-separated with a header row, and
+// each following line names an upgrade and the base item it requires, by
+// description. Pairs whose upgrade is not in armors are ignored; an upgrade
+// whose base is not in armors requires ARMOR_UNAVAILABLE_BASE, so it is
+// never bought.
+// Returns nullptr on I/O error, a malformed line, an item that requires two
+// different base items, or a cycle.
+std::unique_ptr<ArmorDependencies> load_armor_dependencies(const std::string& path, const ArmorVector& armors)
+{
+	std::unique_ptr<ArmorDependencies> failure(nullptr);
+
+	std::ifstream f(path);
+	if (!f)
+	{
+		std::cout << "Failed to load armor dependencies; Cannot open file: " << path << std::endl;
+		return failure;
+	}
+
+	std::unordered_map<std::string, size_t> position;
+	for (size_t i = 0; i < armors.size(); i++)
+	{
+		position[armors[i]->description()] = i;
+	}
+
+	std::unique_ptr<ArmorDependencies> result(new ArmorDependencies(armors.size(), -1));
+
+	size_t line_number = 0;
+	for (std::string line; std::getline(f, line); )
+	{
+		line_number++;
+
+		if ( ! line.empty() && line.back() == '\r' )
+		{
+			line.pop_back();
+		}
+
+		// First line is a header row
+		if ( line_number == 1 || line.empty() )
+		{
+			continue;
+		}
+
+		std::vector<std::string> fields;
+		std::stringstream ss(line);
+		for (std::string field; std::getline(ss, field, '^'); )
+		{
+			fields.push_back(field);
+		}
+
+		auto upgrade = fields.size() == 2 ? position.find(fields[0]) : position.end();
+		auto base = fields.size() == 2 ? position.find(fields[1]) : position.end();
+		int requirement = base != position.end() ? int(base->second) : ARMOR_UNAVAILABLE_BASE;
+		bool conflicting = upgrade != position.end()
+			&& (*result)[upgrade->second] != -1 && (*result)[upgrade->second] != requirement;
+		if (fields.size() != 2 || fields[0] == fields[1] || conflicting)
+		{
+			std::cout
+				<< "Failed to load armor dependencies: Invalid dependency at line " << line_number << std::endl
+				<< "Line: " << line << std::endl
+				;
+			return failure;
+		}
+
+		if (upgrade != position.end())
+		{
+			(*result)[upgrade->second] = requirement;
+		}
+	}
+
+	std::vector<uint32_t> order, next;
+	if ( ! armor_dependency_preorder(*result, armors.size(), order, next) )
+	{
+		std::cout << "Failed to load armor dependencies; Cycle in file: " << path << std::endl;
+		return failure;
+	}
+
+	return result;
+}
+
+
+// True when every item of the subset mask has its base item in the subset too.
+bool armor_subset_closed(const ArmorDependencies& dependencies, uint64_t mask)
+{
+	for (uint64_t rest = mask; rest; rest &= rest - 1)
+	{
+		int parent = armor_requirement_of(dependencies, __builtin_ctzll(rest));
+		if (parent == ARMOR_UNAVAILABLE_BASE || (parent >= 0 && ! (mask >> parent & 1)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// Bytes of heap tree_knapsack_max_defense will use for these arguments, from
+// the same row lifetimes it uses: the DP rows alive at once, plus one choice
+// bit per item and scaled budget unit.
+size_t tree_knapsack_footprint
+(
+	const ArmorVector& armors,
+	double total_cost,
+	const ArmorDependencies& dependencies = ArmorDependencies()
+)
+{
+	const size_t n = armors.size();
+	if (n == 0 || total_cost < 0)
+	{
+		return 0;
+	}
+
+	const size_t width = size_t(armor_scaled_budget(total_cost, armor_cost_scale(armors))) + 1;
+	const size_t bits = n * ((width + 63) / 64 * 8 + sizeof(std::vector<bool>));
+
+	// knapsack_max_defense_generic: one row and the item costs.
+	if (armor_dependencies_none(dependencies))
+	{
+		return bits + width * sizeof(double) + n * sizeof(size_t);
+	}
+
+	std::vector<uint32_t> order, next;
+	armor_dependency_preorder(dependencies, n, order, next);
+
+	std::vector<size_t> last_reader(n + 1, n + 1);
+	for (size_t k = n; k-- > 0; )
+	{
+		last_reader[k + 1] = std::min(last_reader[k + 1], k);
+		last_reader[next[k]] = std::min(last_reader[next[k]], k);
+	}
+
+	// Rows alive while position k is computed: every later row still to be
+	// read, plus the new one.
+	size_t alive = 1, most_alive = 1;
+	for (size_t k = n; k-- > 0; )
+	{
+		most_alive = std::max(most_alive, alive + 1);
+		alive++;
+		for (size_t r : { k + 1, size_t(next[k]) })
+		{
+			if (last_reader[r] == k)
+			{
+				alive--;
+				last_reader[r] = n + 1;
+			}
+		}
+	}
+
+	return bits + most_alive * width * sizeof(double) + (n + 1) * sizeof(std::vector<double>);
+}
+
+
+// Bytes of heap lean_knapsack_max_defense will use for these arguments: two
+// DP rows, and each item's scaled cost, defense and index.
+size_t lean_knapsack_footprint(const ArmorVector& armors, double total_cost)
+{
+	const size_t n = armors.size();
+	if (n == 0 || total_cost < 0)
+	{
+		return 0;
+	}
+
+	const size_t width = size_t(armor_scaled_budget(total_cost, armor_cost_scale(armors))) + 1;
+	return 2 * width * sizeof(double) + n * (sizeof(size_t) + sizeof(double) + sizeof(uint32_t));
+}
+
+
+// Compute the optimal set of armor items within total_cost, as
+// tree_knapsack_max_defense does without dependencies, but holding two DP
+// rows instead of a choice bit per item and budget unit; see
+// knapsack_max_defense_lean_generic. Leaner than the table DP once there
+// are more than about 64 items, and a log n factor slower.
+// The result lists items in their order in armors.
+std::unique_ptr<ArmorVector> lean_knapsack_max_defense(const ArmorVector& armors, double total_cost)
+{
+	return armor_indexes_vector(
+		armors,
+		knapsack_max_defense_lean_generic<double>(ArmorVectorAccess{ armors }, total_cost, armor_cost_scale(armors))
+	);
+}
+
+
+// Compute the optimal set of armor items whose upgrades all come with their
+// base items, by tree-knapsack dynamic programming over the budget in units
+// of 1 / armor_cost_scale(armors).
+// Items are visited in reverse preorder of the forest; best[k][c] is the
+// most defense from the items at preorder positions k and later within
+// scaled budget c, either taking order[k] (best[k + 1]) or skipping its
+// whole subtree (best[next[k]]); an item whose base is unavailable is
+// always skipped. With width = budget * scale + 1 scaled budget units,
+// time is O(n * width), and so is memory for the choices, one bit per item
+// and unit: both grow linearly with n. Only the DP rows of doubles do not;
+// a row is freed once no earlier position refers to it, so the rows held at
+// once grow with the depth of the forest rather than n.
+// Without dependencies this is the plain knapsack of
+// knapsack_max_defense_generic, which needs a single row.
+// Exact when armor_costs_exact. Otherwise the costs it leaves out of the
+// scale are rounded up, so the result still fits but may miss the optimum;
+// the solver registry hands such views to branch and bound instead.
+// Either way the result is re-checked with its costs summed in double, and
+// repaired if the rounding of that sum puts it over, by dropping items no
+// chosen upgrade needs.
+// The result lists items in their order in armors.
+std::unique_ptr<ArmorVector> tree_knapsack_max_defense
+(
+	const ArmorVector& armors,
+	double total_cost,
+	const ArmorDependencies& dependencies = ArmorDependencies()
+)
+{
+	const size_t n = armors.size();
+	std::unique_ptr<ArmorVector> output(new ArmorVector);
+	if (n == 0 || total_cost < 0)
+	{
+		return output;
+	}
+
+	const int64_t scale = armor_cost_scale(armors);
+	if (armor_dependencies_none(dependencies))
+	{
+		return armor_indexes_vector(armors, knapsack_max_defense_generic<double>(ArmorVectorAccess{ armors }, total_cost, scale));
+	}
+
+	std::vector<uint32_t> order, next;
+	bool forest = armor_dependency_preorder(dependencies, n, order, next);
+	assert(forest);
+	(void) forest;
+
+	const size_t width = size_t(armor_scaled_budget(total_cost, scale)) + 1;
+
+	std::vector<int64_t> cost(n);
+	for (size_t k = 0; k < n; k++)
+	{
+		cost[k] = armor_scaled_cost(armors[order[k]]->cost(), scale);
+	}
+
+	// The earliest position that reads each row, after which it is freed.
+	std::vector<size_t> last_reader(n + 1, n + 1);
+	for (size_t k = n; k-- > 0; )
+	{
+		last_reader[k + 1] = std::min(last_reader[k + 1], k);
+		last_reader[next[k]] = std::min(last_reader[next[k]], k);
+	}
+
+	std::vector<std::vector<double>> best(n + 1);
+	std::vector<std::vector<bool>> take(n, std::vector<bool>(width, false));
+	best[n].assign(width, 0.0);
+	for (size_t k = n; k-- > 0; )
+	{
+		const std::vector<double>& taken = best[k + 1];
+		const std::vector<double>& skipped = best[next[k]];
+		const double defense = armors[order[k]]->defense();
+
+		std::vector<double> row(skipped);
+		const bool buyable = armor_requirement_of(dependencies, order[k]) != ARMOR_UNAVAILABLE_BASE;
+		for (size_t c = cost[k]; buyable && c < width; c++)
+		{
+			double with = taken[c - cost[k]] + defense;
+			if (with > row[c])
+			{
+				row[c] = with;
+				take[k][c] = true;
+			}
+		}
+		best[k] = std::move(row);
+
+		for (size_t r : { k + 1, size_t(next[k]) })
+		{
+			if (last_reader[r] == k)
+			{
+				std::vector<double>().swap(best[r]);
+			}
+		}
+	}
+
+	std::vector<char> chosen(n, 0);
+	size_t c = width - 1;
+	for (size_t k = 0; k < n; )
+	{
+		if (take[k][c])
+		{
+			chosen[order[k]] = 1;
+			c -= cost[k];
+			k++;
+		}
+		else
+		{
+			k = next[k];
+		}
+	}
+
+	std::vector<uint32_t> indexes;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (chosen[i])
+		{
+			indexes.push_back(i);
+		}
+	}
+	armor_fit_in_double(
+		ArmorVectorAccess{ armors }, total_cost, indexes,
+		[&](uint32_t i, const std::vector<uint32_t>& rest)
+		{
+			return std::none_of(rest.begin(), rest.end(), [&](uint32_t j) { return armor_requirement_of(dependencies, j) == int(i); });
+		}
+	);
+	return armor_indexes_vector(armors, indexes);
+}
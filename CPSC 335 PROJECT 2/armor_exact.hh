@@ -0,0 +1,907 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_exact.hh
+//
+// Exact solvers beyond exhaustive_max_defense: conflict-aware,
+// cardinality-limited and maximal subset enumeration, and depth-first and
+// best-first branch and bound.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "armor_dp.hh"
+#include "maxtime.hh"
+
+
+// Pairwise conflicts between the items of an ArmorVector of fewer than 64
+// items, such as a two-handed weapon and a shield: bit j of conflicts[i] is
+// set when items i and j may not both be chosen. Always symmetric.
+// An empty ArmorConflicts means no item conflicts with any other.
+typedef std::vector<uint64_t> ArmorConflicts;
+
+
+// Record that armors[i] and armors[j] conflict.
+void add_armor_conflict(ArmorConflicts& conflicts, size_t i, size_t j)
+{
+	assert(i < 64 && j < 64 && i != j);
+	conflicts.resize(std::max(conflicts.size(), std::max(i, j) + 1), 0);
+	conflicts[i] |= uint64_t(1) << j;
+	conflicts[j] |= uint64_t(1) << i;
+}
+
+
+// Conflicts of item i, or 0 if conflicts does not mention it.
+uint64_t armor_conflicts_of(const ArmorConflicts& conflicts, size_t i)
+{
+	return i < conflicts.size() ? conflicts[i] : 0;
+}
+
+
+// Load a conflict graph for armors, which must hold fewer than 64 items.
+// Like the armor database the file is '^'-separated with a header row, and
+// each following line names two conflicting items by description.
+// Pairs naming an item that is not in armors, e.g. one removed by
+// filter_armor_vector, are ignored.
+// Returns nullptr on I/O error or a malformed line.
+std::unique_ptr<ArmorConflicts> load_armor_conflicts(const std::string& path, const ArmorVector& armors)
+{
+	assert(armors.size() < 64);
+
+	std::unique_ptr<ArmorConflicts> failure(nullptr);
+
+	std::ifstream f(path);
+	if (!f)
+	{
+		std::cout << "Failed to load armor conflicts; Cannot open file: " << path << std::endl;
+		return failure;
+	}
+
+	std::unordered_map<std::string, size_t> position;
+	for (size_t i = 0; i < armors.size(); i++)
+	{
+		position[armors[i]->description()] = i;
+	}
+
+	std::unique_ptr<ArmorConflicts> result(new ArmorConflicts(armors.size(), 0));
+
+	size_t line_number = 0;
+	for (std::string line; std::getline(f, line); )
+	{
+		line_number++;
+
+		if ( ! line.empty() && line.back() == '\r' )
+		{
+			line.pop_back();
+		}
+
+		// First line is a header row
+		if ( line_number == 1 || line.empty() )
+		{
+			continue;
+		}
+
+		std::vector<std::string> fields;
+		std::stringstream ss(line);
+		for (std::string field; std::getline(ss, field, '^'); )
+		{
+			fields.push_back(field);
+		}
+
+		if (fields.size() != 2 || fields[0] == fields[1])
+		{
+			std::cout
+				<< "Failed to load armor conflicts: Invalid pair at line " << line_number << std::endl
+				<< "Line: " << line << std::endl
+				;
+			return failure;
+		}
+
+		auto first = position.find(fields[0]), second = position.find(fields[1]);
+		if (first != position.end() && second != position.end())
+		{
+			add_armor_conflict(*result, first->second, second->second);
+		}
+	}
+
+	return result;
+}
+
+
+// True when no two items of the subset mask conflict.
+bool armor_subset_compatible(const ArmorConflicts& conflicts, uint64_t mask)
+{
+	for (uint64_t rest = mask; rest; rest &= rest - 1)
+	{
+		if (armor_conflicts_of(conflicts, __builtin_ctzll(rest)) & mask)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// exhaustive_max_defense restricted to subsets without conflicting items.
+// Subset masks are enumerated in increasing order, bit i selecting
+// armors[i]. When the highest set bit i that conflicts with a higher set
+// bit is found, all 2^i masks sharing bits i and above contain the same
+// conflict, so the whole range is skipped in one step; likewise when the
+// items at bits i and above already exceed the budget.
+// Requires fewer than 64 items.
+std::unique_ptr<ArmorVector> exhaustive_max_defense_conflicts
+(
+	const ArmorVector& armors,
+	double total_cost,
+	const ArmorConflicts& conflicts
+)
+{
+	const int n = armors.size();
+	assert(n < 64);
+
+	double best_defense = -1.0;
+	uint64_t best_mask = 0;
+	const uint64_t end = uint64_t(1) << n;
+
+	for (uint64_t mask = 0; mask < end; )
+	{
+		// Walk the set bits from the highest down, summing as we go.
+		double cost = 0, defense = 0;
+		uint64_t higher = 0;
+		int skip_bit = -1;
+		for (uint64_t rest = mask; rest; )
+		{
+			int bit = 63 - __builtin_clzll(rest);
+			rest &= ~(uint64_t(1) << bit);
+
+			cost += armors[bit]->cost();
+			defense += armors[bit]->defense();
+			if ((armor_conflicts_of(conflicts, bit) & higher) || cost > total_cost)
+			{
+				skip_bit = bit;
+				break;
+			}
+			higher |= uint64_t(1) << bit;
+		}
+
+		if (skip_bit >= 0)
+		{
+			mask = ((mask >> skip_bit) + 1) << skip_bit;
+			continue;
+		}
+
+		if (defense > best_defense)
+		{
+			best_defense = defense;
+			best_mask = mask;
+		}
+		mask++;
+	}
+
+	std::unique_ptr<ArmorVector> output(new ArmorVector);
+	for (int i = 0; i < n; i++)
+	{
+		if (best_mask & (uint64_t(1) << i))
+		{
+			output->push_back(armors[i]);
+		}
+	}
+	return output;
+}
+
+
+// Counters for one depth of a branch-and-bound search tree; depth k is the
+// decision on the k-th item in ratio order, and depth n the leaves.
+struct ArmorSearchDepth
+{
+	// Nodes entered at this depth.
+	uint64_t nodes = 0;
+
+	// Nodes whose subtree was cut because its bound could not beat the
+	// incumbent.
+	uint64_t pruned_by_bound = 0;
+
+	// Nodes whose include branch was skipped because the item did not fit
+	// in the budget left, or conflicted with an item already chosen.
+	uint64_t pruned_by_budget = 0;
+	uint64_t pruned_by_conflict = 0;
+
+	// Seconds spent in the subtrees rooted at this depth, children included.
+	double seconds = 0;
+};
+
+
+// A new best solution found during a search.
+struct ArmorIncumbentUpdate
+{
+	// Since the search started, in seconds and in nodes entered.
+	double seconds;
+	uint64_t nodes;
+
+	size_t depth;
+	double defense;
+};
+
+
+// What a profiled branch-and-bound search did, to tell a weak bound (many
+// nodes deep in the tree, few pruned by bound) from a poor item order (the
+// incumbent improving late).
+struct ArmorSearchProfile
+{
+	std::vector<ArmorSearchDepth> depths;
+	std::vector<ArmorIncumbentUpdate> incumbents;
+
+	// Seconds spent at depth k itself, excluding deeper nodes.
+	double self_seconds(size_t k) const
+	{
+		return depths[k].seconds - (k + 1 < depths.size() ? depths[k + 1].seconds : 0);
+	}
+
+	uint64_t nodes() const
+	{
+		uint64_t total = 0;
+		for (auto& depth : depths)
+		{
+			total += depth.nodes;
+		}
+		return total;
+	}
+};
+
+
+// The items a branch-and-bound search decides on, in the order it decides
+// them: those with positive defense in armor_ratio_order, with the cost and
+// defense at each position.
+struct ArmorSearchOrder
+{
+	std::vector<uint32_t> items;
+	std::vector<double> cost, defense;
+
+	size_t size() const { return items.size(); }
+};
+
+
+//
+ArmorSearchOrder make_armor_search_order(const ArmorVector& armors)
+{
+	ArmorSearchOrder order;
+	for (uint32_t i : armor_ratio_order(ArmorVectorAccess{ armors }))
+	{
+		if (armors[i]->defense() > 0)
+		{
+			order.items.push_back(i);
+			order.cost.push_back(armors[i]->cost());
+			order.defense.push_back(armors[i]->defense());
+		}
+	}
+	return order;
+}
+
+
+// The Dantzig bound of a search node at position k of order: gained plus
+// the most defense the items from k on can add within room, the first one
+// that does not fit taken fractionally. Positions j with skip(j), such as
+// items a choice has blocked, are left out; the bound stays valid and gets
+// tighter.
+template <typename Skip>
+double armor_search_bound(const ArmorSearchOrder& order, size_t k, double room, double gained, Skip skip)
+{
+	for (; k < order.size(); k++)
+	{
+		if (skip(k))
+		{
+			continue;
+		}
+		if (order.cost[k] <= room)
+		{
+			room -= order.cost[k];
+			gained += order.defense[k];
+		}
+		else
+		{
+			return gained + order.defense[k] * room / order.cost[k];
+		}
+	}
+	return gained;
+}
+
+
+// armor_search_bound over every position from k on.
+double armor_search_bound(const ArmorSearchOrder& order, size_t k, double room, double gained)
+{
+	return armor_search_bound(order, k, room, gained, [](size_t) { return false; });
+}
+
+
+// Compute the optimal set of armor items with depth-first branch and bound.
+// Items with positive defense are considered in decreasing defense / cost
+// order; each node first tries including the next item, then excluding it,
+// and a subtree is pruned when the fractional-knapsack (Dantzig) bound of
+// the items left cannot beat the best solution found so far.
+// With conflicts (only for fewer than 64 items), choosing an item blocks
+// every item it conflicts with, and blocked items are left out of the bound,
+// which stays valid and gets tighter.
+// With profile, it is overwritten with per-depth counters and the history
+// of the incumbent; timing every node makes the search several times
+// slower.
+// The result lists items in their order in armors.
+std::unique_ptr<ArmorVector> branch_and_bound_max_defense
+(
+	const ArmorVector& armors,
+	double total_cost,
+	const ArmorConflicts& conflicts = ArmorConflicts(),
+	ArmorSearchProfile* profile = nullptr
+)
+{
+	const size_t n = armors.size();
+	assert(conflicts.empty() || n < 64);
+
+	const ArmorSearchOrder search_order = make_armor_search_order(armors);
+	const std::vector<uint32_t>& order = search_order.items;
+	const std::vector<double>& cost = search_order.cost;
+	const std::vector<double>& defense = search_order.defense;
+
+	// Upper bound on the defense reachable from depth k; items blocked by a
+	// conflict are left out.
+	auto bound = [&](size_t k, double used, double gained, uint64_t blocked)
+	{
+		return armor_search_bound(
+			search_order, k, total_cost - used, gained,
+			[&](size_t j) { return ! conflicts.empty() && (blocked >> order[j] & 1); }
+		);
+	};
+
+	std::vector<char> chosen(n, 0), best_chosen(n, 0);
+	double best_defense = 0;
+
+	typedef std::chrono::steady_clock Clock;
+	const Clock::time_point started = Clock::now();
+	auto seconds_since = [](Clock::time_point then)
+	{
+		return std::chrono::duration<double>(Clock::now() - then).count();
+	};
+	uint64_t visited = 0;
+	if (profile)
+	{
+		*profile = ArmorSearchProfile();
+		profile->depths.resize(order.size() + 1);
+	}
+
+	std::function<void(size_t, double, double, uint64_t)> search =
+		[&](size_t k, double used, double gained, uint64_t blocked)
+	{
+		Clock::time_point entered;
+		if (profile)
+		{
+			entered = Clock::now();
+			profile->depths[k].nodes++;
+			visited++;
+		}
+
+		if (gained > best_defense)
+		{
+			best_defense = gained;
+			best_chosen = chosen;
+			if (profile)
+			{
+				profile->incumbents.push_back({ seconds_since(started), visited, k, gained });
+			}
+		}
+
+		bool leaf = k == order.size();
+		if ( ! leaf && bound(k, used, gained, blocked) <= best_defense )
+		{
+			if (profile)
+			{
+				profile->depths[k].pruned_by_bound++;
+			}
+		}
+		else if ( ! leaf )
+		{
+			size_t item = order[k];
+			bool is_blocked = ! conflicts.empty() && (blocked >> item & 1);
+			if ( ! is_blocked && used + cost[k] <= total_cost )
+			{
+				chosen[item] = 1;
+				search(k + 1, used + cost[k], gained + defense[k], blocked | armor_conflicts_of(conflicts, item));
+				chosen[item] = 0;
+			}
+			else if (profile)
+			{
+				(is_blocked ? profile->depths[k].pruned_by_conflict : profile->depths[k].pruned_by_budget)++;
+			}
+			search(k + 1, used, gained, blocked);
+		}
+
+		if (profile)
+		{
+			profile->depths[k].seconds += seconds_since(entered);
+		}
+	};
+	search(0, 0.0, 0.0, 0);
+
+	std::unique_ptr<ArmorVector> output(new ArmorVector);
+	for (size_t i = 0; i < n; i++)
+	{
+		if (best_chosen[i])
+		{
+			output->push_back(armors[i]);
+		}
+	}
+	return output;
+}
+
+
+// Write profile as a table with one line per depth that was reached, then
+// the incumbent's history.
+void write_armor_search_report(const ArmorSearchProfile& profile, std::ostream& out)
+{
+	out
+		<< std::setw(6) << "depth" << std::setw(14) << "nodes" << std::setw(14) << "bound"
+		<< std::setw(14) << "budget" << std::setw(14) << "conflict" << std::setw(12) << "self ms" << '\n'
+		;
+	for (size_t k = 0; k < profile.depths.size(); k++)
+	{
+		const ArmorSearchDepth& depth = profile.depths[k];
+		if (depth.nodes == 0)
+		{
+			continue;
+		}
+		out
+			<< std::setw(6) << k << std::setw(14) << depth.nodes << std::setw(14) << depth.pruned_by_bound
+			<< std::setw(14) << depth.pruned_by_budget << std::setw(14) << depth.pruned_by_conflict
+			<< std::setw(12) << std::fixed << std::setprecision(3) << profile.self_seconds(k) * 1000
+			<< std::defaultfloat << '\n'
+			;
+	}
+
+	out << profile.nodes() << " nodes, " << profile.incumbents.size() << " incumbents:" << '\n';
+	for (auto& incumbent : profile.incumbents)
+	{
+		out
+			<< "  " << std::fixed << std::setprecision(3) << incumbent.seconds * 1000
+			<< " ms, node " << incumbent.nodes << ", depth " << incumbent.depth << ": "
+			<< std::setprecision(2) << incumbent.defense << std::defaultfloat << '\n'
+			;
+	}
+}
+
+
+// Write profile as collapsed stacks for flamegraph.pl and compatible
+// viewers: one line per depth reached, "branch_and_bound;depth 0;...;depth k"
+// followed by the nanoseconds spent at depth k itself.
+void write_armor_search_flamegraph(const ArmorSearchProfile& profile, std::ostream& out)
+{
+	std::string stack = "branch_and_bound";
+	for (size_t k = 0; k < profile.depths.size() && profile.depths[k].nodes > 0; k++)
+	{
+		stack += ";depth " + std::to_string(k);
+		out << stack << ' ' << std::llround(std::max(0.0, profile.self_seconds(k)) * 1e9) << '\n';
+	}
+}
+
+
+// What a best_first_max_defense search did.
+struct ArmorBestFirstStats
+{
+	// Nodes taken from the queue, and nodes searched depth first once the
+	// queue was full.
+	uint64_t nodes = 0;
+	uint64_t depth_first_nodes = 0;
+
+	// Most nodes ever held at once, and the bytes they took.
+	size_t peak_queue = 0;
+	size_t peak_bytes = 0;
+};
+
+
+// Compute the optimal set of armor items with best-first branch and bound:
+// open nodes wait in a binary max-heap ordered by their Dantzig bound, the
+// deepest first among equals, and the node with the highest bound is always
+// expanded next, so the search ends as soon as the best bound left cannot
+// beat the incumbent. Items are considered in the order
+// branch_and_bound_max_defense uses.
+// Nodes live in a pool with a free list, each with a bit per item chosen so
+// far, and the heap holds pool indexes, so expanding a node allocates
+// nothing once the pool has grown. When the pool would exceed
+// memory_limit bytes, new children are searched depth first on the spot,
+// as branch_and_bound_max_defense would, instead of being queued.
+// The result lists items in their order in armors.
+std::unique_ptr<ArmorVector> best_first_max_defense
+(
+	const ArmorVector& armors,
+	double total_cost,
+	size_t memory_limit = SIZE_MAX,
+	ArmorBestFirstStats* stats = nullptr
+)
+{
+	const size_t n = armors.size();
+
+	const ArmorSearchOrder search_order = make_armor_search_order(armors);
+	const std::vector<uint32_t>& order = search_order.items;
+	const std::vector<double>& cost = search_order.cost;
+	const std::vector<double>& defense = search_order.defense;
+	const size_t m = order.size();
+
+	// Upper bound on the defense reachable from depth k.
+	auto bound = [&](size_t k, double used, double gained)
+	{
+		return armor_search_bound(search_order, k, total_cost - used, gained);
+	};
+
+	// Chosen items are bits over positions in order.
+	const size_t words = std::max<size_t>(1, (m + 63) / 64);
+
+	struct Node
+	{
+		double bound, used, gained;
+		uint32_t depth;
+	};
+	std::vector<Node> pool;
+	std::vector<uint64_t> pool_bits;
+	std::vector<uint32_t> free_slots, heap;
+	const size_t node_bytes = sizeof(Node) + words * sizeof(uint64_t) + 2 * sizeof(uint32_t);
+
+	auto higher = [&](uint32_t a, uint32_t b)
+	{
+		return pool[a].bound < pool[b].bound || (pool[a].bound == pool[b].bound && pool[a].depth < pool[b].depth);
+	};
+
+	std::vector<uint64_t> best_bits(words, 0), work(words, 0);
+	double best_defense = 0;
+	ArmorBestFirstStats local_stats;
+
+	// Search below depth k depth first, with the choices so far in work.
+	std::function<void(size_t, double, double)> dive = [&](size_t k, double used, double gained)
+	{
+		local_stats.depth_first_nodes++;
+		if (gained > best_defense)
+		{
+			best_defense = gained;
+			best_bits = work;
+		}
+		if (k == m || bound(k, used, gained) <= best_defense)
+		{
+			return;
+		}
+		if (used + cost[k] <= total_cost)
+		{
+			work[k / 64] |= uint64_t(1) << (k % 64);
+			dive(k + 1, used + cost[k], gained + defense[k]);
+			work[k / 64] &= ~(uint64_t(1) << (k % 64));
+		}
+		dive(k + 1, used, gained);
+	};
+
+	// Queue the node at depth k with choices bits, or search it depth first
+	// if the pool is full.
+	auto open = [&](size_t k, double used, double gained, const uint64_t* bits)
+	{
+		if (gained > best_defense)
+		{
+			best_defense = gained;
+			best_bits.assign(bits, bits + words);
+		}
+		double node_bound = k == m ? gained : bound(k, used, gained);
+		if (node_bound <= best_defense)
+		{
+			return;
+		}
+
+		uint32_t slot;
+		if ( ! free_slots.empty() )
+		{
+			slot = free_slots.back();
+			free_slots.pop_back();
+		}
+		else if ((pool.size() + 1) * node_bytes <= memory_limit)
+		{
+			slot = pool.size();
+			pool.push_back(Node());
+			pool_bits.resize(pool_bits.size() + words);
+		}
+		else
+		{
+			work.assign(bits, bits + words);
+			dive(k, used, gained);
+			return;
+		}
+
+		pool[slot] = { node_bound, used, gained, uint32_t(k) };
+		std::copy(bits, bits + words, pool_bits.begin() + size_t(slot) * words);
+		heap.push_back(slot);
+		std::push_heap(heap.begin(), heap.end(), higher);
+		local_stats.peak_queue = std::max(local_stats.peak_queue, heap.size());
+	};
+
+	std::vector<uint64_t> bits(words, 0);
+	open(0, 0.0, 0.0, bits.data());
+	while ( ! heap.empty() )
+	{
+		std::pop_heap(heap.begin(), heap.end(), higher);
+		uint32_t slot = heap.back();
+		heap.pop_back();
+		free_slots.push_back(slot);
+
+		const Node node = pool[slot];
+		if (node.bound <= best_defense)
+		{
+			break;
+		}
+		local_stats.nodes++;
+
+		const size_t k = node.depth;
+		std::copy(pool_bits.begin() + size_t(slot) * words, pool_bits.begin() + size_t(slot + 1) * words, bits.begin());
+		if (node.used + cost[k] <= total_cost)
+		{
+			bits[k / 64] |= uint64_t(1) << (k % 64);
+			open(k + 1, node.used + cost[k], node.gained + defense[k], bits.data());
+			bits[k / 64] &= ~(uint64_t(1) << (k % 64));
+		}
+		open(k + 1, node.used, node.gained, bits.data());
+	}
+
+	local_stats.peak_bytes = pool.size() * node_bytes;
+	if (stats)
+	{
+		*stats = local_stats;
+	}
+
+	std::vector<char> chosen(n, 0);
+	for (size_t k = 0; k < m; k++)
+	{
+		if (best_bits[k / 64] >> (k % 64) & 1)
+		{
+			chosen[order[k]] = 1;
+		}
+	}
+	std::unique_ptr<ArmorVector> output(new ArmorVector);
+	for (size_t i = 0; i < n; i++)
+	{
+		if (chosen[i])
+		{
+			output->push_back(armors[i]);
+		}
+	}
+	return output;
+}
+
+
+// Number of subsets of at most max_items of n items, sum of C(n, i) for
+// i <= max_items; saturates at UINT64_MAX.
+uint64_t armor_subsets_at_most(int n, int max_items)
+{
+	uint64_t total = 0, choose = 1;
+	for (int i = 0; i <= std::min(n, max_items); i++)
+	{
+		if (total > UINT64_MAX - choose)
+		{
+			return UINT64_MAX;
+		}
+		total += choose;
+
+		// C(n, i + 1) = C(n, i) * (n - i) / (i + 1), exactly.
+		unsigned __int128 next = (unsigned __int128) choose * (n - i) / (i + 1);
+		choose = next > UINT64_MAX ? UINT64_MAX : uint64_t(next);
+	}
+	return total;
+}
+
+
+// exhaustive_max_defense limited to subsets of at most max_items items.
+// For each size i the C(n, i) masks with i bits set are visited in
+// increasing order with Gosper's hack, and the running sums are updated
+// only for the bits that changed from one mask to the next, so the work is
+// armor_subsets_at_most(n, max_items) rather than 2^n.
+// Costs are summed in units of 1 / armor_cost_scale(armors), so
+// feasibility is exact however many updates are applied, and the result is
+// re-checked in double as tree_knapsack_max_defense's is. Exact when
+// armor_costs_exact; costs that are not whole units are rounded up.
+// Requires fewer than 64 items.
+std::unique_ptr<ArmorVector> exhaustive_max_defense_at_most
+(
+	const ArmorVector& armors,
+	double total_cost,
+	int max_items
+)
+{
+	const int n = armors.size();
+	assert(n < 64 && max_items >= 0);
+
+	const int64_t scale = armor_cost_scale(armors);
+	const int64_t budget = armor_scaled_budget(total_cost, scale);
+	std::vector<int64_t> cost(n);
+	std::vector<double> defense(n);
+	for (int i = 0; i < n; i++)
+	{
+		cost[i] = armor_scaled_cost(armors[i]->cost(), scale);
+		defense[i] = armors[i]->defense();
+	}
+
+	double best_defense = 0;
+	uint64_t best_mask = 0;
+	const uint64_t end = uint64_t(1) << n;
+
+	for (int size = 1; size <= std::min(n, max_items); size++)
+	{
+		uint64_t mask = (uint64_t(1) << size) - 1;
+		int64_t mask_cost = 0;
+		double mask_defense = 0;
+		for (int i = 0; i < size; i++)
+		{
+			mask_cost += cost[i];
+			mask_defense += defense[i];
+		}
+
+		for (;;)
+		{
+			if (mask_cost <= budget && mask_defense > best_defense)
+			{
+				best_defense = mask_defense;
+				best_mask = mask;
+			}
+
+			// Gosper's hack: the next larger mask with the same popcount.
+			uint64_t lowest = mask & -mask;
+			uint64_t ripple = mask + lowest;
+			if (ripple >= end || ripple == 0)
+			{
+				break;
+			}
+			uint64_t next = ripple | (((mask ^ ripple) >> 2) / lowest);
+
+			for (uint64_t gone = mask & ~next; gone; gone &= gone - 1)
+			{
+				int bit = __builtin_ctzll(gone);
+				mask_cost -= cost[bit];
+				mask_defense -= defense[bit];
+			}
+			for (uint64_t added = next & ~mask; added; added &= added - 1)
+			{
+				int bit = __builtin_ctzll(added);
+				mask_cost += cost[bit];
+				mask_defense += defense[bit];
+			}
+			mask = next;
+		}
+	}
+
+	std::vector<uint32_t> chosen;
+	for (int i = 0; i < n; i++)
+	{
+		if (best_mask >> i & 1)
+		{
+			chosen.push_back(i);
+		}
+	}
+	armor_fit_in_double(ArmorVectorAccess{ armors }, total_cost, chosen);
+	return armor_indexes_vector(armors, chosen);
+}
+
+
+// Compute the optimal set of armor items by enumerating only maximal
+// feasible subsets, those where no item left out fits in the budget left
+// over. Some optimal subset is always maximal, since adding an item with
+// positive defense never lowers the total; items without positive defense
+// are never chosen and take no part.
+// Items are visited in increasing cost order, so the first item left out
+// is the cheapest one left out, and a subset is maximal exactly when its
+// leftover budget is below that item's cost. Backtracking prunes a branch
+// as soon as even taking every remaining item could not bring the leftover
+// below it, and stops at the first item that does not fit, since no later
+// one will either.
+// Costs are compared in units of 1 / armor_cost_scale(armors), and the
+// result is re-checked in double as tree_knapsack_max_defense's is. Exact
+// when armor_costs_exact; costs that are not whole units are rounded up, so
+// the result still fits but may miss the optimum, and the solver registry
+// hands such views to branch and bound instead.
+// If evaluated is not null it receives the number of maximal subsets
+// evaluated, to compare with the 2^n of exhaustive_max_defense.
+// The result lists items in their order in armors.
+std::unique_ptr<ArmorVector> maximal_max_defense
+(
+	const ArmorVector& armors,
+	double total_cost,
+	uint64_t* evaluated = nullptr
+)
+{
+	const size_t n = armors.size();
+
+	std::vector<uint32_t> order;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (armors[i]->defense() > 0)
+		{
+			order.push_back(i);
+		}
+	}
+	std::stable_sort(
+		order.begin(), order.end(),
+		[&](uint32_t a, uint32_t b) { return armors[a]->cost() < armors[b]->cost(); }
+	);
+
+	const int64_t scale = armor_cost_scale(armors);
+	const int64_t budget = armor_scaled_budget(total_cost, scale);
+	const size_t m = order.size();
+
+	std::vector<int64_t> cost(m), suffix_cost(m + 1, 0);
+	std::vector<double> defense(m);
+	for (size_t k = m; k-- > 0; )
+	{
+		cost[k] = armor_scaled_cost(armors[order[k]]->cost(), scale);
+		defense[k] = armors[order[k]]->defense();
+		suffix_cost[k] = suffix_cost[k + 1] + cost[k];
+	}
+
+	std::vector<char> chosen(n, 0), best_chosen(n, 0);
+	double best_defense = 0;
+	uint64_t leaves = 0;
+
+	// left_out is the cost of the first item left out so far, or -1.
+	std::function<void(size_t, int64_t, double, int64_t)> search =
+		[&](size_t k, int64_t room, double gained, int64_t left_out)
+	{
+		if (left_out >= 0 && room - suffix_cost[k] >= left_out)
+		{
+			return;
+		}
+
+		if (k == m || cost[k] > room)
+		{
+			// Nothing from k on fits; maximal if the first item left out
+			// does not fit either.
+			if (left_out < 0 || room < left_out)
+			{
+				leaves++;
+				if (gained > best_defense)
+				{
+					best_defense = gained;
+					best_chosen = chosen;
+				}
+			}
+			return;
+		}
+
+		chosen[order[k]] = 1;
+		search(k + 1, room - cost[k], gained + defense[k], left_out);
+		chosen[order[k]] = 0;
+
+		search(k + 1, room, gained, left_out < 0 ? cost[k] : left_out);
+	};
+	if (budget >= 0)
+	{
+		search(0, budget, 0.0, -1);
+	}
+
+	if (evaluated)
+	{
+		*evaluated = leaves;
+	}
+
+	std::vector<uint32_t> indexes;
+	for (size_t i = 0; i < n; i++)
+	{
+		if (best_chosen[i])
+		{
+			indexes.push_back(i);
+		}
+	}
+	armor_fit_in_double(ArmorVectorAccess{ armors }, total_cost, indexes);
+	return armor_indexes_vector(armors, indexes);
+}
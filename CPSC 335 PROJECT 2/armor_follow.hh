@@ -0,0 +1,427 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_follow.hh
+//
+// Follow a CSV armor database that is being appended to, like tail -f,
+// and publish a new version of the in-memory catalogue for every batch of
+// appended rows.
+//
+// Linux only; uses inotify.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <array>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "maxtime.hh"
+
+
+// Callback that receives the items appended in one batch, after the version
+// containing them has been published. Indexes built over the catalogue use
+// this to update themselves incrementally instead of rebuilding.
+// When rewritten is true the file was replaced or truncated: every item
+// seen before is gone, and appended holds the whole new catalogue, so the
+// index must be cleared before adding them.
+typedef std::function<void(const ArmorVector& appended, uint64_t version, bool rewritten)> ArmorAppendVisitor;
+
+
+// One published version of a followed catalogue: its first size() items.
+// Every version since the file was last loaded from its start shares one
+// append-only store, whose chunks double in size and never move, and whose
+// items are never changed once published; so publishing a batch costs only
+// the batch, and older versions stay valid alongside newer ones.
+class ArmorFollowerVersion
+{
+	//
+	public:
+
+		//
+		size_t size() const { return _size; }
+
+		// Item i, in file order; O(1).
+		const std::shared_ptr<ArmorItem>& operator[](size_t i) const
+		{
+			assert(i < _size);
+			int chunk = 63 - __builtin_clzll(i + 1);
+			return _store->chunks[chunk][i + 1 - (size_t(1) << chunk)];
+		}
+
+		// The items as an ArmorVector, for the solvers; O(size).
+		std::unique_ptr<ArmorVector> armors() const
+		{
+			std::unique_ptr<ArmorVector> output(new ArmorVector);
+			output->reserve(_size);
+			for (size_t i = 0; i < _size; i++)
+			{
+				output->push_back((*this)[i]);
+			}
+			return output;
+		}
+
+	//
+	private:
+
+		friend class ArmorFollower;
+
+		// Chunk c holds items 2^c - 1 to 2^(c + 1) - 2.
+		struct Store
+		{
+			std::array<std::unique_ptr<std::shared_ptr<ArmorItem>[]>, 64> chunks;
+
+			// Only the follower calls this, and only past every published item.
+			void set(size_t i, const std::shared_ptr<ArmorItem>& armor)
+			{
+				int chunk = 63 - __builtin_clzll(i + 1);
+				if ( ! chunks[chunk] )
+				{
+					chunks[chunk].reset(new std::shared_ptr<ArmorItem>[size_t(1) << chunk]);
+				}
+				chunks[chunk][i + 1 - (size_t(1) << chunk)] = armor;
+			}
+		};
+
+		ArmorFollowerVersion(std::shared_ptr<const Store> store, size_t size)
+			:
+			_store(store),
+			_size(size)
+		{ }
+
+		std::shared_ptr<const Store> _store;
+		size_t _size;
+};
+
+
+// Keeps an in-memory copy of a CSV armor database up to date as rows are
+// appended to the file. Only the newly appended bytes are read and parsed;
+// a trailing row that has not been completely written yet is held back until
+// its newline arrives. Rows with the wrong number of fields are reported as
+// load_armor_database reports them, and counted.
+// Readers call current() to get an immutable version of the catalogue, which
+// stays valid however many later versions are published.
+// The directory is watched rather than the file, so a file renamed over the
+// path is noticed too. If the path names a different file than last time,
+// or the file shrinks, it is assumed to have been rewritten and is reloaded;
+// an in-place rewrite that leaves the file no shorter is not detected.
+class ArmorFollower
+{
+	//
+	public:
+
+		//
+		explicit ArmorFollower(const std::string& path)
+			:
+			_path(path),
+			_device(0),
+			_inode(0),
+			_offset(0),
+			_line_number(0),
+			_store(new ArmorFollowerVersion::Store),
+			_stored(0),
+			_malformed(0),
+			_current(new ArmorFollowerVersion(_store, 0)),
+			_version(0),
+			_inotify_fd(-1),
+			_wake_fd(-1)
+		{ }
+
+		ArmorFollower(const ArmorFollower&) = delete;
+		ArmorFollower& operator=(const ArmorFollower&) = delete;
+
+		~ArmorFollower() { stop(); }
+
+		// Set the callback for appended items. Call before start.
+		void on_append(const ArmorAppendVisitor& visit) { _on_append = visit; }
+
+		// Load the file as it is now and start following it on a background
+		// thread. Returns false on I/O error.
+		bool start()
+		{
+			assert(_inotify_fd < 0);
+
+			size_t slash = _path.find_last_of('/');
+			std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : _path.substr(0, slash);
+			_name = slash == std::string::npos ? _path : _path.substr(slash + 1);
+
+			_inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			if (_inotify_fd < 0 || _wake_fd < 0
+				|| inotify_add_watch(_inotify_fd, directory.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO) < 0)
+			{
+				std::cout << "Failed to follow armor database; Cannot watch file: " << _path << std::endl;
+				close_fds();
+				return false;
+			}
+
+			if ( ! poll() )
+			{
+				close_fds();
+				return false;
+			}
+
+			_watcher = std::thread([this]() { watch(); });
+			return true;
+		}
+
+		// Stop following. The last published version stays available.
+		void stop()
+		{
+			if (_watcher.joinable())
+			{
+				uint64_t one = 1;
+				ssize_t written = ::write(_wake_fd, &one, sizeof(one));
+				(void) written;
+				_watcher.join();
+			}
+			close_fds();
+		}
+
+		// Read and publish whatever has been appended since the last call.
+		// The watcher thread calls this on every change notification; it may
+		// also be called directly, e.g. without start().
+		// Returns false on I/O error.
+		bool poll()
+		{
+			std::lock_guard<std::mutex> poll_lock(_poll_mutex);
+
+			int fd = ::open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+			struct stat info;
+			if (fd < 0 || fstat(fd, &info) != 0)
+			{
+				std::cout << "Failed to follow armor database; Cannot open file: " << _path << std::endl;
+				if (fd >= 0)
+				{
+					::close(fd);
+				}
+				return false;
+			}
+
+			// The first poll loads the file from its start, so is no rewrite.
+			uint64_t size = info.st_size;
+			bool replaced = _inode != 0 && (info.st_dev != _device || info.st_ino != _inode);
+			bool rewritten = replaced || size < _offset;
+			_device = info.st_dev;
+			_inode = info.st_ino;
+			if (rewritten)
+			{
+				_offset = 0;
+				_line_number = 0;
+				_pending.clear();
+			}
+
+			std::string bytes(size - _offset, '\0');
+			size_t read_bytes = 0;
+			while (read_bytes < bytes.size())
+			{
+				ssize_t n = ::pread(fd, &bytes[read_bytes], bytes.size() - read_bytes, _offset + read_bytes);
+				if (n < 0 && errno == EINTR)
+				{
+					continue;
+				}
+				if (n <= 0)
+				{
+					break;
+				}
+				read_bytes += n;
+			}
+			::close(fd);
+			bytes.resize(read_bytes);
+			_offset += bytes.size();
+
+			ArmorVector appended;
+			size_t malformed = 0;
+			size_t line_start = 0;
+			for (size_t newline; (newline = bytes.find('\n', line_start)) != std::string::npos; line_start = newline + 1)
+			{
+				_pending.append(bytes, line_start, newline - line_start);
+				_line_number++;
+
+				// First line is a header row
+				std::shared_ptr<ArmorItem> armor;
+				if (_line_number > 1)
+				{
+					switch (parse_armor_line(_pending, _line_number, armor))
+					{
+						case ArmorLineStatus::parsed:
+							appended.push_back(armor);
+							break;
+						case ArmorLineStatus::skipped:
+							break;
+						case ArmorLineStatus::malformed:
+							malformed++;
+							break;
+					}
+				}
+				_pending.clear();
+			}
+			_pending.append(bytes, line_start, std::string::npos);
+
+			if (rewritten)
+			{
+				// Published versions keep the old store.
+				_store.reset(new ArmorFollowerVersion::Store);
+				_stored = 0;
+			}
+			for (auto& armor : appended)
+			{
+				_store->set(_stored++, armor);
+			}
+
+			uint64_t version;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_malformed += malformed;
+				if (appended.empty() && ! rewritten)
+				{
+					return true;
+				}
+				_current.reset(new ArmorFollowerVersion(_store, _stored));
+				version = ++_version;
+			}
+
+			if (_on_append)
+			{
+				_on_append(appended, version, rewritten);
+			}
+			return true;
+		}
+
+		// The latest published catalogue.
+		std::shared_ptr<const ArmorFollowerVersion> current() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _current;
+		}
+
+		// Number of versions published so far; the initial load is version 1.
+		uint64_t version() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _version;
+		}
+
+		// Number of rows with the wrong number of fields read so far, which
+		// were left out of the catalogue.
+		uint64_t malformed_rows() const
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _malformed;
+		}
+
+	//
+	private:
+
+		// Body of the watcher thread.
+		void watch()
+		{
+			pollfd fds[2] =
+			{
+				{ _inotify_fd, POLLIN, 0 },
+				{ _wake_fd, POLLIN, 0 }
+			};
+
+			for (;;)
+			{
+				if (::poll(fds, 2, -1) < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+					return;
+				}
+
+				if (fds[1].revents)
+				{
+					return;
+				}
+
+				// Drain the notifications, noting whether any was about the
+				// file; which kind does not matter since poll() compares the
+				// file with what it read last.
+				alignas(inotify_event) char events[4096];
+				bool followed = false;
+				for (ssize_t n; (n = ::read(_inotify_fd, events, sizeof(events))) > 0; )
+				{
+					for (ssize_t offset = 0; offset < n; )
+					{
+						const inotify_event* event = reinterpret_cast<const inotify_event*>(events + offset);
+						followed = followed || (event->len > 0 && _name == event->name);
+						offset += sizeof(inotify_event) + event->len;
+					}
+				}
+
+				if (followed)
+				{
+					poll();
+				}
+			}
+		}
+
+		void close_fds()
+		{
+			if (_inotify_fd >= 0)
+			{
+				::close(_inotify_fd);
+				_inotify_fd = -1;
+			}
+			if (_wake_fd >= 0)
+			{
+				::close(_wake_fd);
+				_wake_fd = -1;
+			}
+		}
+
+		std::string _path;
+
+		// The file's name within its directory, which is what is watched.
+		std::string _name;
+
+		// Identity of the file last read, 0 before the first poll.
+		dev_t _device;
+		ino_t _inode;
+
+		// Bytes of the file consumed so far, and lines completed so far.
+		uint64_t _offset;
+		size_t _line_number;
+
+		// Start of a row whose newline has not been written yet.
+		std::string _pending;
+
+		// Store of the items read since the file was last loaded from its
+		// start, and how many it holds; only poll() touches these.
+		std::shared_ptr<ArmorFollowerVersion::Store> _store;
+		size_t _stored;
+
+		// Malformed row count, published catalogue and its version, guarded
+		// by _mutex.
+		uint64_t _malformed;
+		std::shared_ptr<const ArmorFollowerVersion> _current;
+		uint64_t _version;
+		mutable std::mutex _mutex;
+
+		// Serialises poll() between the watcher thread and direct callers.
+		std::mutex _poll_mutex;
+
+		ArmorAppendVisitor _on_append;
+
+		int _inotify_fd, _wake_fd;
+		std::thread _watcher;
+};
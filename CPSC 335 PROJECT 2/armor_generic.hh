@@ -0,0 +1,497 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_generic.hh
+//
+// Greedy, exhaustive and knapsack DP solvers written once as templates over
+// the numeric type they compute in and a policy for reaching the items, so
+// each storage format gets its own specialisation with no virtual calls.
+// greedy_max_defense, exhaustive_max_defense, their column and view variants,
+// the dependency-free tree_knapsack_max_defense and lean_knapsack_max_defense
+// all run these.
+//
+// Value types: double, float, and int64_t fixed point.
+// Access policies live with the storage they read: ArmorVectorAccess and
+// ArmorSnapshotMap (a memory-mapped binary snapshot) in maxtime.hh,
+// ArmorColumnsAccess in armor_columns.hh and ArmorViewAccess (a filtered
+// view of an ArmorCatalogue) in armor_catalogue.hh. An access policy is any
+// type with size(), cost(i) and defense(i).
+//
+// Solvers return the indexes of the chosen items within the access policy.
+// Whatever the value type, a result always fits the budget when its costs
+// are summed in double, in index order: each solver re-checks its answer
+// that way, and the knapsack repairs it with armor_fit_in_double.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+
+// Units per gold or defense point of the int64_t fixed-point value type;
+// enough for ride.csv's cents and tenths exactly.
+const int64_t ARMOR_FIXED_POINT_SCALE = 10000;
+
+
+// How close to a whole number, relative to its size, a value scaled to
+// integer units must be to count as one.
+const double ARMOR_SCALE_TOLERANCE = 1e-9;
+
+
+// True when value * scale is a whole number to within ARMOR_SCALE_TOLERANCE.
+bool armor_scales_exactly(double value, int64_t scale)
+{
+	const double scaled = value * scale;
+	return std::fabs(scaled - std::round(scaled)) <= ARMOR_SCALE_TOLERANCE * std::max(1.0, std::fabs(scaled));
+}
+
+
+// cost in units of 1 / scale for the integer solvers: the nearest whole
+// number if armor_scales_exactly, otherwise rounded up, so that a set whose
+// units fit the budget also fits it in exact arithmetic.
+int64_t armor_scaled_cost(double cost, int64_t scale)
+{
+	return int64_t(armor_scales_exactly(cost, scale) ? std::round(cost * scale) : std::ceil(cost * scale));
+}
+
+
+// total_cost in units of 1 / scale, as armor_scaled_cost but rounded down.
+int64_t armor_scaled_budget(double total_cost, int64_t scale)
+{
+	return int64_t(armor_scales_exactly(total_cost, scale) ? std::round(total_cost * scale) : std::floor(total_cost * scale));
+}
+
+
+// Repair chosen, indexes into access in increasing order, until their costs
+// summed in double fit total_cost, by dropping the item with the least
+// defense that droppable(i, chosen) allows. The integer solvers decide in
+// units of 1 / scale, and a set that fits exactly in units can still be over
+// by the rounding of the double sum, e.g. 0.1 + 0.2 within 0.3; costs that
+// armor_scales_exactly counts as whole to within its tolerance can be over
+// by that much more. O(chosen) when the set fits, as it all but always does.
+template <typename Access, typename Droppable>
+void armor_fit_in_double(const Access& access, double total_cost, std::vector<uint32_t>& chosen, const Droppable& droppable)
+{
+	for (;;)
+	{
+		double used = 0;
+		for (uint32_t i : chosen)
+		{
+			used += double(access.cost(i));
+		}
+		if (used <= total_cost || chosen.empty())
+		{
+			return;
+		}
+
+		auto weakest = chosen.end();
+		for (auto i = chosen.begin(); i != chosen.end(); ++i)
+		{
+			if (droppable(*i, chosen)
+				&& (weakest == chosen.end() || double(access.defense(*i)) < double(access.defense(*weakest))))
+			{
+				weakest = i;
+			}
+		}
+		assert(weakest != chosen.end());
+		chosen.erase(weakest);
+	}
+}
+
+
+// armor_fit_in_double where any item may be dropped.
+template <typename Access>
+void armor_fit_in_double(const Access& access, double total_cost, std::vector<uint32_t>& chosen)
+{
+	armor_fit_in_double(access, total_cost, chosen, [](uint32_t, const std::vector<uint32_t>&) { return true; });
+}
+
+
+// Conversions between double and a solver value type, and how far a sum of
+// n converted costs can be from the converted budget: converting each cost
+// and the budget, and rounding each addition.
+template <typename Value>
+struct ArmorValueTraits
+{
+	static Value from_double(double x) { return Value(x); }
+	static double to_double(Value x) { return double(x); }
+
+	static Value rounding_margin(size_t n, double total_cost)
+	{
+		return Value((n + 2) * std::numeric_limits<Value>::epsilon() * std::fabs(total_cost));
+	}
+};
+
+
+// int64_t is fixed point, in units of 1 / ARMOR_FIXED_POINT_SCALE. Sums are
+// exact; each conversion is off by at most half a unit.
+template <>
+struct ArmorValueTraits<int64_t>
+{
+	static int64_t from_double(double x) { return std::llround(x * ARMOR_FIXED_POINT_SCALE); }
+	static double to_double(int64_t x) { return double(x) / ARMOR_FIXED_POINT_SCALE; }
+
+	static int64_t rounding_margin(size_t n, double)
+	{
+		return int64_t(n / 2 + 1);
+	}
+};
+
+
+// Item indexes in decreasing defense / cost order, ties in index order: the
+// order greedy_max_defense takes items in. Ratios are computed once per item
+// in the access policy's own type, so over float columns two ratios closer
+// than float precision count as tied.
+template <typename Access>
+std::vector<uint32_t> armor_ratio_order(const Access& access)
+{
+	typedef decltype(access.defense(0) / access.cost(0)) Ratio;
+
+	const size_t n = access.size();
+	std::vector<Ratio> ratio(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		ratio[i] = access.defense(i) / access.cost(i);
+	}
+
+	std::vector<uint32_t> order(n);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(
+		order.begin(), order.end(),
+		[&](uint32_t a, uint32_t b) { return ratio[a] > ratio[b]; }
+	);
+	return order;
+}
+
+
+// The second half of greedy_max_defense: walk order and take each item that
+// still fits. Sums and the budget test are in Value; an item must also fit
+// with the costs summed in double, so rounding in float or fixed point can
+// leave an item out but never exceed total_cost.
+// Returns indexes in the order taken.
+template <typename Value, typename Access>
+std::vector<uint32_t> greedy_fit_generic(const Access& access, const std::vector<uint32_t>& order, double total_cost)
+{
+	typedef ArmorValueTraits<Value> Traits;
+
+	const Value budget = Traits::from_double(total_cost);
+	Value used = Value(0);
+	double exact_used = 0.0;
+	std::vector<uint32_t> chosen;
+	for (uint32_t i : order)
+	{
+		const double exact_cost = double(access.cost(i));
+		const Value cost = Traits::from_double(exact_cost);
+		if (used + cost <= budget && exact_used + exact_cost <= total_cost)
+		{
+			used += cost;
+			exact_used += exact_cost;
+			chosen.push_back(i);
+		}
+	}
+	return chosen;
+}
+
+
+// greedy_max_defense: take items in armor_ratio_order whenever they still
+// fit, as greedy_fit_generic.
+// Returns indexes in the order taken.
+template <typename Value, typename Access>
+std::vector<uint32_t> greedy_max_defense_generic(const Access& access, double total_cost)
+{
+	return greedy_fit_generic<Value>(access, armor_ratio_order(access), total_cost);
+}
+
+
+// exhaustive_max_defense in Value: the subset of at most 63 items with the
+// most defense within budget, bit i of a subset mask selecting item i.
+// Costs and defenses are converted to Value once. The items are split into
+// the low L and the remaining high bits of the mask; the sums of all 2^L low
+// subsets are tabulated once, and each high subset is combined with the
+// whole table in a branch-free loop over contiguous arrays, which the
+// compiler vectorises.
+// Subsets whose Value cost is within ArmorValueTraits::rounding_margin of
+// total_cost are not trusted: they are collected and re-verified in double
+// through exact, so the result always fits the budget and no subset that
+// fits is lost to rounding. Defense is compared in Value, so in float the
+// result is optimal to within float precision.
+// Returns indexes in increasing order.
+template <typename Value, typename Access, typename Exact>
+std::vector<uint32_t> exhaustive_max_defense_generic(const Access& access, double total_cost, const Exact& exact)
+{
+	typedef ArmorValueTraits<Value> Traits;
+
+	const int n = access.size();
+	assert(n < 64);
+	assert(size_t(n) == exact.size());
+
+	std::vector<Value> cost(n), defense(n);
+	for (int i = 0; i < n; i++)
+	{
+		cost[i] = Traits::from_double(access.cost(i));
+		defense[i] = Traits::from_double(access.defense(i));
+	}
+
+	const int low_bits = std::min(n, 10), high_bits = n - low_bits;
+	const size_t low_count = size_t(1) << low_bits;
+
+	std::vector<Value> low_cost(low_count, Value(0)), low_defense(low_count, Value(0));
+	for (size_t j = 1; j < low_count; j++)
+	{
+		int bit = __builtin_ctzll(j);
+		low_cost[j] = low_cost[j & (j - 1)] + cost[bit];
+		low_defense[j] = low_defense[j & (j - 1)] + defense[bit];
+	}
+
+	const Value budget = Traits::from_double(total_cost), margin = Traits::rounding_margin(n, total_cost);
+	const Value sure_limit = budget - margin, band_limit = budget + margin;
+
+	Value best_defense = Value(-1);
+	uint64_t best_mask = 0;
+	std::vector<uint64_t> uncertain;
+
+	for (uint64_t high = 0; high < (uint64_t(1) << high_bits); high++)
+	{
+		Value high_cost = Value(0), high_defense = Value(0);
+		for (int bit = 0; bit < high_bits; bit++)
+		{
+			if (high & (uint64_t(1) << bit))
+			{
+				high_cost += cost[low_bits + bit];
+				high_defense += defense[low_bits + bit];
+			}
+		}
+
+		// Branch-free pass: does any subset in this block beat the best so
+		// far, or fall in the uncertain band? Both are rare, so the scalar
+		// rescans below seldom run.
+		// Flags the same width as Value keep float and double lanes aligned.
+		typedef typename std::conditional<sizeof(Value) == 4, int32_t, int64_t>::type Flag;
+		Flag improves = 0, in_band = 0;
+		for (size_t j = 0; j < low_count; j++)
+		{
+			Value c = high_cost + low_cost[j], d = high_defense + low_defense[j];
+			improves |= (c <= sure_limit) & (d > best_defense);
+			in_band |= (c > sure_limit) & (c <= band_limit);
+		}
+
+		if (improves)
+		{
+			for (size_t j = 0; j < low_count; j++)
+			{
+				Value c = high_cost + low_cost[j], d = high_defense + low_defense[j];
+				if (c <= sure_limit && d > best_defense)
+				{
+					best_defense = d;
+					best_mask = (high << low_bits) | j;
+				}
+			}
+		}
+
+		if (in_band)
+		{
+			for (size_t j = 0; j < low_count; j++)
+			{
+				Value c = high_cost + low_cost[j];
+				if (c > sure_limit && c <= band_limit)
+				{
+					uncertain.push_back((high << low_bits) | j);
+				}
+			}
+		}
+	}
+
+	// Re-verify in double. The best trusted subset is feasible by the error
+	// bound; the uncertain ones only count if they really fit.
+	auto exact_defense = [&](uint64_t mask, double& mask_cost)
+	{
+		double mask_defense = 0;
+		mask_cost = 0;
+		for (int i = 0; i < n; i++)
+		{
+			if (mask >> i & 1)
+			{
+				mask_cost += double(exact.cost(i));
+				mask_defense += double(exact.defense(i));
+			}
+		}
+		return mask_defense;
+	};
+
+	double mask_cost;
+	double best_exact = exact_defense(best_mask, mask_cost);
+	if ( ! (mask_cost <= total_cost) )
+	{
+		best_exact = -INFINITY;
+		best_mask = 0;
+	}
+	for (uint64_t mask : uncertain)
+	{
+		double mask_defense = exact_defense(mask, mask_cost);
+		if (mask_cost <= total_cost && mask_defense > best_exact)
+		{
+			best_exact = mask_defense;
+			best_mask = mask;
+		}
+	}
+
+	std::vector<uint32_t> chosen;
+	for (int i = 0; i < n; i++)
+	{
+		if (best_mask >> i & 1)
+		{
+			chosen.push_back(i);
+		}
+	}
+	return chosen;
+}
+
+
+// exhaustive_max_defense_generic, re-verifying through access itself.
+template <typename Value, typename Access>
+std::vector<uint32_t> exhaustive_max_defense_generic(const Access& access, double total_cost)
+{
+	return exhaustive_max_defense_generic<Value>(access, total_cost, access);
+}
+
+
+// 0/1 knapsack DP, as tree_knapsack_max_defense without dependencies:
+// costs are integers in units of 1 / cost_scale, from armor_scaled_cost,
+// defense totals are Value, and one choice bit per item and budget unit
+// reconstructs the answer, which armor_fit_in_double then re-checks.
+// Optimal when every cost is a whole number of units; a cost that is not is
+// rounded up, so the result still fits but may miss the optimum.
+// Each item is read through the access policy once more for the re-check.
+// Returns indexes in increasing order.
+template <typename Value, typename Access>
+std::vector<uint32_t> knapsack_max_defense_generic(const Access& access, double total_cost, int64_t cost_scale)
+{
+	typedef ArmorValueTraits<Value> Traits;
+
+	const size_t n = access.size();
+	std::vector<uint32_t> chosen;
+	if (n == 0 || total_cost < 0)
+	{
+		return chosen;
+	}
+
+	const size_t width = size_t(armor_scaled_budget(total_cost, cost_scale)) + 1;
+	std::vector<Value> best(width, Value(0));
+	std::vector<std::vector<bool>> take(n, std::vector<bool>(width, false));
+	std::vector<size_t> cost(n);
+
+	for (size_t k = 0; k < n; k++)
+	{
+		cost[k] = armor_scaled_cost(double(access.cost(k)), cost_scale);
+		const Value defense = Traits::from_double(access.defense(k));
+		for (size_t c = width; c-- > cost[k]; )
+		{
+			Value with = best[c - cost[k]] + defense;
+			if (with > best[c])
+			{
+				best[c] = with;
+				take[k][c] = true;
+			}
+		}
+	}
+
+	size_t c = width - 1;
+	for (size_t k = n; k-- > 0; )
+	{
+		if (take[k][c])
+		{
+			chosen.push_back(k);
+			c -= cost[k];
+		}
+	}
+	std::reverse(chosen.begin(), chosen.end());
+	armor_fit_in_double(access, total_cost, chosen);
+	return chosen;
+}
+
+
+// knapsack_max_defense_generic in O(width) memory instead of a choice bit
+// per item and budget unit, by Hirschberg's divide and conquer: the most
+// defense the first half of the items can reach within every budget, and
+// the second half, give the split of the budget in an optimal answer, and
+// each half is then solved within its share. Two rows are held at once, at
+// the price of O(n * width * log n) time instead of O(n * width).
+// Costs, exactness and the re-check are as knapsack_max_defense_generic.
+// Returns indexes in increasing order.
+template <typename Value, typename Access>
+std::vector<uint32_t> knapsack_max_defense_lean_generic(const Access& access, double total_cost, int64_t cost_scale)
+{
+	typedef ArmorValueTraits<Value> Traits;
+
+	const size_t n = access.size();
+	std::vector<uint32_t> chosen;
+	if (n == 0 || total_cost < 0)
+	{
+		return chosen;
+	}
+
+	std::vector<size_t> cost(n);
+	std::vector<Value> defense(n);
+	for (size_t k = 0; k < n; k++)
+	{
+		cost[k] = armor_scaled_cost(double(access.cost(k)), cost_scale);
+		defense[k] = Traits::from_double(access.defense(k));
+	}
+
+	// best[c]: the most defense from items first to last - 1 within c.
+	auto best_within = [&](size_t first, size_t last, size_t room)
+	{
+		std::vector<Value> best(room + 1, Value(0));
+		for (size_t k = first; k < last; k++)
+		{
+			for (size_t c = room + 1; c-- > cost[k]; )
+			{
+				best[c] = std::max(best[c], best[c - cost[k]] + defense[k]);
+			}
+		}
+		return best;
+	};
+
+	// Append an optimal choice from items first to last - 1 within room.
+	std::function<void(size_t, size_t, size_t)> solve = [&](size_t first, size_t last, size_t room)
+	{
+		if (last - first == 1)
+		{
+			if (cost[first] <= room && defense[first] > Value(0))
+			{
+				chosen.push_back(first);
+			}
+			return;
+		}
+
+		const size_t middle = first + (last - first) / 2;
+		size_t split = 0;
+		{
+			std::vector<Value> left = best_within(first, middle, room);
+			std::vector<Value> right = best_within(middle, last, room);
+			for (size_t c = 1; c <= room; c++)
+			{
+				if (left[c] + right[room - c] > left[split] + right[room - split])
+				{
+					split = c;
+				}
+			}
+		}
+		solve(first, middle, split);
+		solve(middle, last, room - split);
+	};
+	solve(0, n, size_t(armor_scaled_budget(total_cost, cost_scale)));
+
+	armor_fit_in_double(access, total_cost, chosen);
+	return chosen;
+}
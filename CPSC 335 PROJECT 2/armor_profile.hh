@@ -0,0 +1,332 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_profile.hh
+//
+// Summarise the cost and defense distributions of an armor catalogue, to
+// guide which solver to use and how to tune it.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <ostream>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "maxtime.hh"
+
+
+// Streaming approximate quantiles in bounded memory (a KLL-style sketch).
+// Values are buffered in levels of at most k items; when a level fills up it
+// is sorted and every other item, starting at a random offset, is promoted to
+// the next level where each item stands for twice as many values.
+// Rank error is roughly proportional to 1/k.
+class QuantileSketch
+{
+	//
+	public:
+
+		//
+		explicit QuantileSketch(size_t k = 256, unsigned seed = 335)
+			:
+			_k(k),
+			_count(0),
+			_random(seed)
+		{
+			assert(k >= 2);
+		}
+
+		// Add one value.
+		void add(double value)
+		{
+			if (_levels.empty())
+			{
+				_levels.emplace_back();
+			}
+			_levels[0].push_back(value);
+			_count++;
+
+			for (size_t level = 0; level < _levels.size() && _levels[level].size() >= _k; level++)
+			{
+				compact(level);
+			}
+		}
+
+		// Number of values added so far.
+		uint64_t count() const { return _count; }
+
+		// The approximate q-quantile, for q in [0, 1]. Requires count() > 0.
+		double quantile(double q) const
+		{
+			assert(_count > 0);
+
+			std::vector<std::pair<double, uint64_t>> weighted;
+			for (size_t level = 0; level < _levels.size(); level++)
+			{
+				for (double value : _levels[level])
+				{
+					weighted.emplace_back(value, uint64_t(1) << level);
+				}
+			}
+			std::sort(weighted.begin(), weighted.end());
+
+			uint64_t total = 0;
+			for (auto& item : weighted)
+			{
+				total += item.second;
+			}
+
+			double target = q * total;
+			uint64_t seen = 0;
+			for (auto& item : weighted)
+			{
+				seen += item.second;
+				if (seen >= target)
+				{
+					return item.first;
+				}
+			}
+			return weighted.back().first;
+		}
+
+	//
+	private:
+
+		void compact(size_t level)
+		{
+			if (level + 1 == _levels.size())
+			{
+				_levels.emplace_back();
+			}
+
+			auto& items = _levels[level];
+			std::sort(items.begin(), items.end());
+			for (size_t i = _random() % 2; i < items.size(); i += 2)
+			{
+				_levels[level + 1].push_back(items[i]);
+			}
+			items.clear();
+		}
+
+		size_t _k;
+		uint64_t _count;
+		std::vector<std::vector<double>> _levels;
+		std::minstd_rand _random;
+};
+
+
+// Quantiles reported for each distribution in an ArmorProfile.
+const std::vector<double> ARMOR_PROFILE_QUANTILES = { 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99 };
+
+
+// Summary statistics of one numeric column.
+struct ArmorColumnProfile
+{
+	double min = 0, max = 0, mean = 0, stddev = 0;
+
+	// Largest number of decimal places used by any value, up to 6.
+	// Not computed for ratios.
+	int decimals = 0;
+
+	// Approximate values at ARMOR_PROFILE_QUANTILES.
+	std::vector<double> quantiles;
+};
+
+
+// Properties of a catalogue that matter when choosing and tuning a solver.
+struct ArmorProfile
+{
+	size_t count = 0;
+
+	// Items with zero or negative defense, which filter_armor_vector drops.
+	size_t non_positive_defense = 0;
+
+	// Items whose (cost, defense) pair, or description, repeats an earlier item.
+	size_t duplicate_pairs = 0;
+	size_t duplicate_descriptions = 0;
+
+	ArmorColumnProfile cost, defense;
+
+	// The defense / cost ratio that greedy_max_defense orders by.
+	ArmorColumnProfile ratio;
+
+	// Pearson correlation between cost and defense. Strongly correlated
+	// catalogues are the hard instances for bound-based exact search.
+	double correlation = 0;
+
+	// Costs that need more than 6 decimal places, like 1 / 3, so have no
+	// exact integer scale; the table DP would have to round them.
+	size_t inexact_costs = 0;
+};
+
+
+// Number of decimal places needed to write value exactly, up to 6.
+int armor_decimal_places(double value)
+{
+	double scaled = std::fabs(value);
+	for (int places = 0; places < 6; places++)
+	{
+		if (std::fabs(scaled - std::round(scaled)) <= ARMOR_SCALE_TOLERANCE * std::max(1.0, scaled))
+		{
+			return places;
+		}
+		scaled *= 10;
+	}
+	return 6;
+}
+
+
+// Profile armors in a single pass, plus the sketch queries at the end.
+ArmorProfile profile_armor_vector(const ArmorVector& armors)
+{
+	ArmorProfile profile;
+	profile.count = armors.size();
+	if (armors.empty())
+	{
+		return profile;
+	}
+
+	struct PairHash
+	{
+		size_t operator()(const std::pair<double, double>& p) const
+		{
+			return std::hash<double>()(p.first) * 31 + std::hash<double>()(p.second);
+		}
+	};
+	std::unordered_set<std::pair<double, double>, PairHash> pairs;
+	std::unordered_set<std::string> descriptions;
+	pairs.reserve(armors.size());
+	descriptions.reserve(armors.size());
+
+	QuantileSketch cost_sketch, defense_sketch, ratio_sketch;
+
+	// Running means, sums of squared deviations from them and the co-moment
+	// of cost and defense, by Welford's update. Unlike sums of squares less
+	// n * mean^2 these do not cancel for large, tightly clustered values.
+	double mean_c = 0, mean_d = 0, mean_r = 0, m2_c = 0, m2_d = 0, m2_r = 0, m2_cd = 0;
+	double seen = 0;
+
+	profile.cost.min = profile.defense.min = profile.ratio.min = INFINITY;
+	profile.cost.max = profile.defense.max = profile.ratio.max = -INFINITY;
+
+	for (auto& armor : armors)
+	{
+		double c = armor->cost(), d = armor->defense(), r = d / c;
+
+		seen++;
+		double delta_c = c - mean_c, delta_d = d - mean_d, delta_r = r - mean_r;
+		mean_c += delta_c / seen;
+		mean_d += delta_d / seen;
+		mean_r += delta_r / seen;
+		m2_c += delta_c * (c - mean_c);
+		m2_d += delta_d * (d - mean_d);
+		m2_r += delta_r * (r - mean_r);
+		m2_cd += delta_c * (d - mean_d);
+
+		profile.cost.min = std::min(profile.cost.min, c);
+		profile.cost.max = std::max(profile.cost.max, c);
+		profile.defense.min = std::min(profile.defense.min, d);
+		profile.defense.max = std::max(profile.defense.max, d);
+		profile.ratio.min = std::min(profile.ratio.min, r);
+		profile.ratio.max = std::max(profile.ratio.max, r);
+
+		profile.cost.decimals = std::max(profile.cost.decimals, armor_decimal_places(c));
+		if ( ! armor_scales_exactly(c, 1000000) )
+		{
+			profile.inexact_costs++;
+		}
+		profile.defense.decimals = std::max(profile.defense.decimals, armor_decimal_places(d));
+
+		if (d <= 0)
+		{
+			profile.non_positive_defense++;
+		}
+		if ( ! pairs.insert(std::make_pair(c, d)).second )
+		{
+			profile.duplicate_pairs++;
+		}
+		if ( ! descriptions.insert(armor->description()).second )
+		{
+			profile.duplicate_descriptions++;
+		}
+
+		cost_sketch.add(c);
+		defense_sketch.add(d);
+		ratio_sketch.add(r);
+	}
+
+	double n = armors.size();
+	auto finish = [n](ArmorColumnProfile& column, double mean, double m2, const QuantileSketch& sketch)
+	{
+		column.mean = mean;
+		column.stddev = std::sqrt(m2 / n);
+		for (double q : ARMOR_PROFILE_QUANTILES)
+		{
+			column.quantiles.push_back(sketch.quantile(q));
+		}
+	};
+	finish(profile.cost, mean_c, m2_c, cost_sketch);
+	finish(profile.defense, mean_d, m2_d, defense_sketch);
+	finish(profile.ratio, mean_r, m2_r, ratio_sketch);
+
+	double covariance = m2_cd / n;
+	double scale = profile.cost.stddev * profile.defense.stddev;
+	profile.correlation = scale > 0 ? covariance / scale : 0;
+
+	return profile;
+}
+
+
+// Write profile as a single JSON object.
+void write_armor_profile_json(const ArmorProfile& profile, std::ostream& out)
+{
+	auto number = [](double value)
+	{
+		char digits[32];
+		std::snprintf(digits, sizeof(digits), "%.10g", value);
+		return std::string(digits);
+	};
+
+	auto column = [&](const char* name, const ArmorColumnProfile& c)
+	{
+		out
+			<< "\"" << name << "\":{"
+			<< "\"min\":" << number(c.min)
+			<< ",\"max\":" << number(c.max)
+			<< ",\"mean\":" << number(c.mean)
+			<< ",\"stddev\":" << number(c.stddev)
+			<< ",\"decimals\":" << c.decimals
+			<< ",\"quantiles\":{"
+			;
+		for (size_t i = 0; i < c.quantiles.size(); i++)
+		{
+			out << (i ? "," : "") << "\"" << number(ARMOR_PROFILE_QUANTILES[i]) << "\":" << number(c.quantiles[i]);
+		}
+		out << "}}";
+	};
+
+	out
+		<< "{\"count\":" << profile.count
+		<< ",\"non_positive_defense\":" << profile.non_positive_defense
+		<< ",\"duplicate_pairs\":" << profile.duplicate_pairs
+		<< ",\"duplicate_descriptions\":" << profile.duplicate_descriptions
+		<< ",\"inexact_costs\":" << profile.inexact_costs
+		<< ",\"correlation\":" << number(profile.correlation)
+		<< ","
+		;
+	column("cost", profile.cost);
+	out << ",";
+	column("defense", profile.defense);
+	out << ",";
+	column("ratio", profile.ratio);
+	out << "}" << '\n';
+}
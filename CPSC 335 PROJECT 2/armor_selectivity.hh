@@ -0,0 +1,285 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_selectivity.hh
+//
+// How many items a filter matches, without building the filtered vector:
+// exact counts of defense ranges from a sorted defense index, and cheap
+// estimates for predicates over several columns from histograms and a
+// sample, for planning a solve before paying for it.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "maxtime.hh"
+
+
+// The defenses of a catalogue's items that filter_armor_vector can keep,
+// sorted, so the number of matches of any defense range is two binary
+// searches.
+class ArmorDefenseIndex
+{
+	//
+	public:
+
+		//
+		explicit ArmorDefenseIndex(const ArmorVector& armors)
+		{
+			for (auto& armor : armors)
+			{
+				if (armor->defense() > 0)
+				{
+					_defenses.push_back(armor->defense());
+				}
+			}
+			std::sort(_defenses.begin(), _defenses.end());
+		}
+
+		// Number of items armor_matches_filter accepts, in O(log n).
+		size_t count(double min_defense, double max_defense) const
+		{
+			if ( ! (min_defense <= max_defense) )
+			{
+				return 0;
+			}
+			auto first = std::lower_bound(_defenses.begin(), _defenses.end(), min_defense);
+			auto last = std::upper_bound(_defenses.begin(), _defenses.end(), max_defense);
+			return first < last ? last - first : 0;
+		}
+
+		// Size of the vector filter_armor_vector would return.
+		size_t count(double min_defense, double max_defense, int total_size) const
+		{
+			return std::min(count(min_defense, max_defense), size_t(std::max(total_size, 0)));
+		}
+
+		// Items with positive defense.
+		size_t size() const { return _defenses.size(); }
+
+	//
+	private:
+
+		std::vector<double> _defenses;
+};
+
+
+// Equi-depth histogram of one column: bucket boundaries at evenly spaced
+// ranks, so each bucket holds about the same number of values. Range counts
+// are estimated by interpolating linearly within the buckets at each end,
+// in O(log buckets); the error is at most about two buckets' worth of
+// values, however skewed the column.
+class ArmorHistogram
+{
+	//
+	public:
+
+		//
+		ArmorHistogram() { }
+
+		//
+		ArmorHistogram(std::vector<double> values, size_t buckets = 64)
+		{
+			assert(buckets > 0);
+			if (values.empty())
+			{
+				return;
+			}
+			std::sort(values.begin(), values.end());
+
+			const size_t n = values.size();
+			buckets = std::min(buckets, n);
+			for (size_t b = 0; b <= buckets; b++)
+			{
+				double bound = values[std::min(n - 1, b * n / buckets)];
+				if (_bounds.empty() || bound > _bounds.back())
+				{
+					_bounds.push_back(bound);
+					_at_most.push_back(std::upper_bound(values.begin(), values.end(), bound) - values.begin());
+				}
+			}
+		}
+
+		// Number of values, exactly.
+		size_t size() const { return _at_most.empty() ? 0 : _at_most.back(); }
+
+		// Estimated number of values at most x.
+		double at_most(double x) const
+		{
+			if (_bounds.empty() || x < _bounds.front())
+			{
+				return 0;
+			}
+			if (x >= _bounds.back())
+			{
+				return size();
+			}
+			size_t b = std::upper_bound(_bounds.begin(), _bounds.end(), x) - _bounds.begin() - 1;
+			double fraction = (x - _bounds[b]) / (_bounds[b + 1] - _bounds[b]);
+			return _at_most[b] + fraction * (_at_most[b + 1] - _at_most[b]);
+		}
+
+		// Estimated number of values in [min, max].
+		double count(double min, double max) const
+		{
+			if ( ! (min <= max) )
+			{
+				return 0;
+			}
+			return std::max(0.0, at_most(max) - at_most(std::nextafter(min, -INFINITY)));
+		}
+
+	//
+	private:
+
+		// Distinct boundaries, and how many values are at most each one.
+		std::vector<double> _bounds;
+		std::vector<size_t> _at_most;
+};
+
+
+// A filter on several columns at once, all bounds inclusive. Like
+// filter_armor_vector it only ever matches items with positive defense.
+struct ArmorPredicate
+{
+	double min_cost = -INFINITY, max_cost = INFINITY;
+	double min_defense = -INFINITY, max_defense = INFINITY;
+	double min_ratio = -INFINITY, max_ratio = INFINITY;
+};
+
+
+// True if armor satisfies predicate.
+bool armor_matches_predicate(const ArmorItem& armor, const ArmorPredicate& predicate)
+{
+	double c = armor.cost(), d = armor.defense(), r = d / c;
+	return d > 0
+		&& c >= predicate.min_cost && c <= predicate.max_cost
+		&& d >= predicate.min_defense && d <= predicate.max_defense
+		&& r >= predicate.min_ratio && r <= predicate.max_ratio
+		;
+}
+
+
+// Summaries of a catalogue's items with positive defense for estimating how
+// many items an ArmorPredicate matches without scanning: a histogram per
+// column, and a fixed-size uniform sample of whole items. A predicate on a
+// single column is answered from its histogram. Columns are strongly
+// correlated in catalogues like ride.csv (ratio is defense / cost), so
+// multiplying per-column selectivities would be badly off; a predicate on
+// several columns is evaluated on the sample instead.
+class ArmorSelectivity
+{
+	//
+	public:
+
+		//
+		explicit ArmorSelectivity(const ArmorVector& armors, size_t buckets = 64, size_t sample_size = 1024, unsigned seed = 335)
+		{
+			std::vector<double> costs, defenses, ratios;
+			std::minstd_rand random(seed);
+			for (auto& armor : armors)
+			{
+				if (armor->defense() <= 0)
+				{
+					continue;
+				}
+				costs.push_back(armor->cost());
+				defenses.push_back(armor->defense());
+				ratios.push_back(armor->defense() / armor->cost());
+
+				// Reservoir sampling: item k replaces a random slot with
+				// probability sample_size / k.
+				if (_sample.size() < sample_size)
+				{
+					_sample.push_back(armor);
+				}
+				else
+				{
+					size_t slot = std::uniform_int_distribution<size_t>(0, costs.size() - 1)(random);
+					if (slot < sample_size)
+					{
+						_sample[slot] = armor;
+					}
+				}
+			}
+			_cost = ArmorHistogram(costs, buckets);
+			_defense = ArmorHistogram(defenses, buckets);
+			_ratio = ArmorHistogram(ratios, buckets);
+		}
+
+		// Items with positive defense.
+		size_t size() const { return _defense.size(); }
+
+		const ArmorHistogram& cost() const { return _cost; }
+		const ArmorHistogram& defense() const { return _defense; }
+		const ArmorHistogram& ratio() const { return _ratio; }
+
+		// Estimated number of items matching predicate. O(log buckets) for
+		// a single column, O(sample size) for several; the sample's standard
+		// error is about n * sqrt(s * (1 - s) / sample size) for selectivity s.
+		double estimate(const ArmorPredicate& predicate) const
+		{
+			bool by_cost = predicate.min_cost > -INFINITY || predicate.max_cost < INFINITY;
+			bool by_defense = predicate.min_defense > -INFINITY || predicate.max_defense < INFINITY;
+			bool by_ratio = predicate.min_ratio > -INFINITY || predicate.max_ratio < INFINITY;
+
+			if (by_cost + by_defense + by_ratio > 1)
+			{
+				size_t matches = 0;
+				for (auto& armor : _sample)
+				{
+					matches += armor_matches_predicate(*armor, predicate);
+				}
+				return _sample.empty() ? 0 : double(size()) * matches / _sample.size();
+			}
+			if (by_cost)
+			{
+				return _cost.count(predicate.min_cost, predicate.max_cost);
+			}
+			if (by_ratio)
+			{
+				return _ratio.count(predicate.min_ratio, predicate.max_ratio);
+			}
+			return _defense.count(predicate.min_defense, predicate.max_defense);
+		}
+
+		// Estimate of the most items predicate can match, whatever the
+		// correlation: the smallest single-column count.
+		double upper_estimate(const ArmorPredicate& predicate) const
+		{
+			return std::min({
+				_cost.count(predicate.min_cost, predicate.max_cost),
+				_defense.count(predicate.min_defense, predicate.max_defense),
+				_ratio.count(predicate.min_ratio, predicate.max_ratio)
+			});
+		}
+
+	//
+	private:
+
+		ArmorHistogram _cost, _defense, _ratio;
+		ArmorVector _sample;
+};
+
+
+// Number of items armors has matching predicate, by a full scan; what
+// ArmorSelectivity estimates.
+size_t count_armor_predicate(const ArmorVector& armors, const ArmorPredicate& predicate)
+{
+	size_t count = 0;
+	for (auto& armor : armors)
+	{
+		if (armor_matches_predicate(*armor, predicate))
+		{
+			count++;
+		}
+	}
+	return count;
+}
@@ -0,0 +1,364 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_solver.hh
+//
+// One interface for every solver, and a registry of them by name, so that
+// batch queries, benchmarks and tests can pick up a new engine without
+// being wired to it by hand.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "armor_approx.hh"
+#include "armor_bound.hh"
+#include "armor_columns.hh"
+#include "armor_dp.hh"
+#include "armor_exact.hh"
+#include "armor_profile.hh"
+#include "maxtime.hh"
+
+
+// What a solver promises about its answers and inputs.
+struct ArmorSolverCapabilities
+{
+	// Always returns an optimal subset.
+	bool exact;
+
+	// Returns at least (1 - epsilon) times the optimal defense, for the
+	// epsilon in its ArmorSolveContext. Solvers that are neither exact nor
+	// approximate are heuristics with no guarantee. exhaustive_float is
+	// approximate rather than exact: it compares defenses in float, so it
+	// can miss the optimum by float precision, far below any useful epsilon.
+	bool approximate;
+
+	// Largest number of items the solver accepts at all.
+	size_t max_n;
+
+	// Largest number of items it solves within about a second on catalogues
+	// like ride.csv; benchmarks, tests and batch queries stay within it.
+	size_t fast_n;
+};
+
+
+// Per-call options, and what the solver reports back.
+struct ArmorSolveContext
+{
+	// Accuracy asked of approximate solvers.
+	double epsilon = 0.1;
+
+	// Subsets or search nodes evaluated, for solvers that count them.
+	uint64_t evaluated = 0;
+
+	// Filled in by branch and bound when set; see branch_and_bound_max_defense.
+	ArmorSearchProfile* search_profile = nullptr;
+
+	// Most heap, in bytes, the solve may use. A solver whose predicted
+	// footprint is larger hands over to its fallback instead of running.
+	size_t memory_limit = SIZE_MAX;
+
+	// Set by the solve: the solvers that actually ran or handed over, in
+	// order, e.g. "tree_dp>branch_and_bound", and the footprint predicted
+	// for the first of them.
+	std::string path;
+	size_t predicted_bytes = 0;
+
+	// Set by the solve: the solution's totals, the Dantzig upper bound of
+	// the view, and so how far from optimal the solution can be.
+	ArmorSolutionGap gap;
+};
+
+
+class ArmorSolver;
+const ArmorSolver* find_armor_solver(const std::string& name);
+
+
+// A named solver. view is the set of items to choose from, typically the
+// result of a filter, and budget the most gold the chosen items may cost.
+class ArmorSolver
+{
+	//
+	public:
+
+		typedef std::function<std::unique_ptr<ArmorVector>(const ArmorVector& view, double budget, ArmorSolveContext& context)> SolveFunction;
+
+		// Predicts the heap bytes a solve with these arguments will use, or
+		// SIZE_MAX if the solver cannot keep its promise on them at all.
+		typedef std::function<size_t(const ArmorVector& view, double budget, const ArmorSolveContext& context)> FootprintFunction;
+
+		// A solver without a footprint function is assumed to need little
+		// memory. fallback names the solver to hand over to when the
+		// footprint exceeds the context's memory_limit.
+		ArmorSolver
+		(
+			const std::string& name,
+			const ArmorSolverCapabilities& capabilities,
+			const SolveFunction& solve,
+			const FootprintFunction& footprint = FootprintFunction(),
+			const std::string& fallback = ""
+		)
+			:
+			_name(name),
+			_capabilities(capabilities),
+			_solve(solve),
+			_footprint(footprint),
+			_fallback(fallback)
+		{ }
+
+		const std::string& name() const { return _name; }
+
+		const ArmorSolverCapabilities& capabilities() const { return _capabilities; }
+
+		// True if view may have n items.
+		bool accepts(size_t n) const { return n <= _capabilities.max_n; }
+
+		// Heap bytes a solve with these arguments is predicted to use.
+		size_t footprint(const ArmorVector& view, double budget, const ArmorSolveContext& context) const
+		{
+			return _footprint ? _footprint(view, budget, context) : 0;
+		}
+
+		// Name of the solver to hand over to when over the memory limit.
+		const std::string& fallback() const { return _fallback; }
+
+		// Solve; requires accepts(view.size()).
+		// If the predicted footprint exceeds context.memory_limit, or is
+		// SIZE_MAX, and there is a fallback, the fallback solves instead,
+		// subject to the same limit; context.path records which way it went.
+		// With no fallback the solve runs regardless. Whichever solver runs, context.gap is
+		// filled in, in O(n) time.
+		std::unique_ptr<ArmorVector> solve(const ArmorVector& view, double budget, ArmorSolveContext& context) const
+		{
+			assert(accepts(view.size()));
+
+			size_t predicted = footprint(view, budget, context);
+			if (context.path.empty())
+			{
+				context.predicted_bytes = predicted;
+			}
+			context.path += context.path.empty() ? _name : ">" + _name;
+
+			// Never hand back to a solver already on the path.
+			const ArmorSolver* fallback = _fallback.empty() ? nullptr : find_armor_solver(_fallback);
+			std::stringstream steps(context.path);
+			for (std::string step; fallback && std::getline(steps, step, '>'); )
+			{
+				if (step == _fallback)
+				{
+					fallback = nullptr;
+				}
+			}
+
+			const bool unable = predicted == SIZE_MAX || predicted > context.memory_limit;
+			if (unable && fallback && fallback->accepts(view.size()))
+			{
+				return fallback->solve(view, budget, context);
+			}
+			auto solution = _solve(view, budget, context);
+			context.gap = armor_solution_gap(view, budget, *solution);
+			return solution;
+		}
+
+		// Solve with default options.
+		std::unique_ptr<ArmorVector> solve(const ArmorVector& view, double budget) const
+		{
+			ArmorSolveContext context;
+			return solve(view, budget, context);
+		}
+
+	//
+	private:
+
+		std::string _name;
+		ArmorSolverCapabilities _capabilities;
+		SolveFunction _solve;
+		FootprintFunction _footprint;
+		std::string _fallback;
+};
+
+
+// Every registered solver, in registration order. The built-in solvers are
+// registered on first use. Over a memory limit the table DP first falls
+// back to the lean DP, which drops the choice bits for two rows and a log n
+// factor in time, and then to branch and bound, which is still exact and
+// needs O(n) memory; the FPTAS falls back to greedy local search; best-first search keeps its queue within
+// the limit itself, continuing depth first. The table DP and the maximal
+// search are only exact when every cost is a whole number of their integer
+// units (armor_costs_exact), so on other views they, and the lean DP, hand
+// over whatever the limit, rather than round costs or size a table by a
+// scale of 10^6.
+std::vector<ArmorSolver>& armor_solvers()
+{
+	static std::vector<ArmorSolver> solvers =
+	{
+		{
+			"greedy", { false, false, SIZE_MAX, 10000 },
+			[](const ArmorVector& view, double budget, ArmorSolveContext&)
+			{
+				return greedy_max_defense(view, budget);
+			}
+		},
+		{
+			"greedy_local", { false, false, SIZE_MAX, 2000 },
+			[](const ArmorVector& view, double budget, ArmorSolveContext&)
+			{
+				return greedy_local_search_max_defense(view, budget);
+			}
+		},
+		{
+			"fptas", { false, true, SIZE_MAX, 200 },
+			[](const ArmorVector& view, double budget, ArmorSolveContext& context)
+			{
+				return fptas_max_defense(view, budget, context.epsilon);
+			},
+			[](const ArmorVector& view, double budget, const ArmorSolveContext& context)
+			{
+				return fptas_footprint(view, budget, context.epsilon);
+			},
+			"greedy_local"
+		},
+		{
+			"exhaustive", { true, false, 63, 20 },
+			[](const ArmorVector& view, double budget, ArmorSolveContext& context)
+			{
+				context.evaluated = uint64_t(1) << view.size();
+				return exhaustive_max_defense(view, budget);
+			}
+		},
+		{
+			"exhaustive_float", { false, true, 63, 24 },
+			[](const ArmorVector& view, double budget, ArmorSolveContext& context)
+			{
+				context.evaluated = uint64_t(1) << view.size();
+				return exhaustive_max_defense_columns(make_armor_columns<float>(view), view, budget);
+			}
+		},
+		{
+			"maximal", { true, false, SIZE_MAX, 24 },
+			[](const ArmorVector& view, double budget, ArmorSolveContext& context)
+			{
+				return maximal_max_defense(view, budget, &context.evaluated);
+			},
+			[](const ArmorVector& view, double, const ArmorSolveContext&)
+			{
+				return armor_costs_exact(view) ? size_t(0) : SIZE_MAX;
+			},
+			"branch_and_bound"
+		},
+		{
+			"branch_and_bound", { true, false, SIZE_MAX, 10000 },
+			[](const ArmorVector& view, double budget, ArmorSolveContext& context)
+			{
+				return branch_and_bound_max_defense(view, budget, ArmorConflicts(), context.search_profile);
+			}
+		},
+		{
+			"best_first", { true, false, SIZE_MAX, 10000 },
+			[](const ArmorVector& view, double budget, ArmorSolveContext& context)
+			{
+				ArmorBestFirstStats stats;
+				auto solution = best_first_max_defense(view, budget, context.memory_limit, &stats);
+				context.evaluated = stats.nodes + stats.depth_first_nodes;
+				return solution;
+			}
+		},
+		{
+			"tree_dp", { true, false, SIZE_MAX, 500 },
+			[](const ArmorVector& view, double budget, ArmorSolveContext&)
+			{
+				return tree_knapsack_max_defense(view, budget);
+			},
+			[](const ArmorVector& view, double budget, const ArmorSolveContext&)
+			{
+				return armor_costs_exact(view) ? tree_knapsack_footprint(view, budget) : SIZE_MAX;
+			},
+			"lean_dp"
+		},
+		{
+			"lean_dp", { true, false, SIZE_MAX, 500 },
+			[](const ArmorVector& view, double budget, ArmorSolveContext&)
+			{
+				return lean_knapsack_max_defense(view, budget);
+			},
+			[](const ArmorVector& view, double budget, const ArmorSolveContext&)
+			{
+				return armor_costs_exact(view) ? lean_knapsack_footprint(view, budget) : SIZE_MAX;
+			},
+			"branch_and_bound"
+		}
+	};
+	return solvers;
+}
+
+
+// Add solver to the registry, replacing any registered solver of that name.
+void register_armor_solver(const ArmorSolver& solver)
+{
+	auto& solvers = armor_solvers();
+	for (auto& existing : solvers)
+	{
+		if (existing.name() == solver.name())
+		{
+			existing = solver;
+			return;
+		}
+	}
+	solvers.push_back(solver);
+}
+
+
+// The registered solver called name, or nullptr. The pointer stays valid
+// until the next register_armor_solver.
+const ArmorSolver* find_armor_solver(const std::string& name)
+{
+	for (auto& solver : armor_solvers())
+	{
+		if (solver.name() == name)
+		{
+			return &solver;
+		}
+	}
+	return nullptr;
+}
+
+
+// Solver name that asks armor_exact_solver_for to choose one from the
+// profile of the items being solved.
+const std::string ARMOR_AUTO_SOLVER = "auto";
+
+
+// Correlation between cost and defense from which armor_exact_solver_for
+// prefers the table DP.
+const double ARMOR_STRONG_CORRELATION = 0.9;
+
+
+// Name of the registered exact solver best suited to items with this
+// profile. Costs without an exact integer scale rule out the table DP, which
+// would have to round them, so they go to branch_and_bound. Strongly
+// correlated cost and defense are the hard instances for branch_and_bound,
+// whose fractional bound then prunes little, so they go to tree_dp when it
+// solves that many items quickly. Everything else goes to branch_and_bound.
+std::string armor_exact_solver_for(const ArmorProfile& profile)
+{
+	const ArmorSolver* table = find_armor_solver("tree_dp");
+	if
+	(
+		profile.inexact_costs == 0
+		&& profile.correlation >= ARMOR_STRONG_CORRELATION
+		&& table
+		&& profile.count <= table->capabilities().fast_n
+	)
+	{
+		return "tree_dp";
+	}
+	return "branch_and_bound";
+}
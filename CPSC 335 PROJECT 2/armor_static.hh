@@ -0,0 +1,199 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_static.hh
+//
+// Fixed armor tables compiled into the binary, and constexpr versions of
+// greedy_max_defense and exhaustive_max_defense, so the loadouts for such a
+// table can be computed by the compiler and kept as constant data:
+//
+//	constexpr auto table = make_static_armor_table({ { "helmet", 50.0, 20.0 }, ... });
+//	constexpr auto best = exhaustive_max_defense_static(table, 500.0);
+//
+// Compilers cap the work of a constant expression. With GCC's default limit
+// the exhaustive search handles up to 16 items, taking a few seconds of
+// compile time at that size; Clang's default is lower (-fconstexpr-steps).
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "maxtime.hh"
+
+
+// One row of a static table; an ArmorItem whose description is a literal.
+struct StaticArmorItem
+{
+	const char* description = nullptr;
+	double cost = 0;
+	double defense = 0;
+};
+
+
+// N armor items known at compile time.
+template <size_t N>
+struct StaticArmorTable
+{
+	static_assert(N > 0 && N < 64, "static armor tables hold 1 to 63 items");
+
+	StaticArmorItem items[N] = {};
+
+	constexpr size_t size() const { return N; }
+	constexpr const StaticArmorItem& operator[](size_t i) const { return items[i]; }
+};
+
+
+// A table from a braced list of rows.
+template <size_t N>
+constexpr StaticArmorTable<N> make_static_armor_table(const StaticArmorItem (&items)[N])
+{
+	StaticArmorTable<N> table;
+	for (size_t i = 0; i < N; i++)
+	{
+		table.items[i] = items[i];
+	}
+	return table;
+}
+
+
+// True when every row would make a valid ArmorItem: a non-empty description
+// and a positive cost. Meant for static_assert next to the table.
+template <size_t N>
+constexpr bool static_armor_table_valid(const StaticArmorTable<N>& table)
+{
+	for (size_t i = 0; i < N; i++)
+	{
+		if (table[i].description == nullptr || table[i].description[0] == '\0' || ! (table[i].cost > 0))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+// The items a solver chose from a StaticArmorTable<N>, by index, with their
+// total cost and defense.
+template <size_t N>
+struct StaticArmorLoadout
+{
+	size_t count = 0;
+	uint32_t items[N] = {};
+	double cost = 0;
+	double defense = 0;
+
+	constexpr size_t size() const { return count; }
+	constexpr uint32_t operator[](size_t k) const { return items[k]; }
+
+	constexpr bool contains(uint32_t i) const
+	{
+		for (size_t k = 0; k < count; k++)
+		{
+			if (items[k] == i)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	constexpr void push_back(const StaticArmorTable<N>& table, uint32_t i)
+	{
+		items[count++] = i;
+		cost += table[i].cost;
+		defense += table[i].defense;
+	}
+};
+
+
+// greedy_max_defense: repeatedly take the remaining item with the highest
+// defense / cost ratio, the first of equals, if it still fits. Same items
+// in the same order, with the cost summed in the same order.
+template <size_t N>
+constexpr StaticArmorLoadout<N> greedy_max_defense_static(const StaticArmorTable<N>& table, double total_cost)
+{
+	StaticArmorLoadout<N> output;
+	bool used[N] = {};
+	for (size_t round = 0; round < N; round++)
+	{
+		size_t best = N;
+		for (size_t i = 0; i < N; i++)
+		{
+			if ( ! used[i] && (best == N || table[i].defense / table[i].cost > table[best].defense / table[best].cost) )
+			{
+				best = i;
+			}
+		}
+		used[best] = true;
+		if (output.cost + table[best].cost <= total_cost)
+		{
+			output.push_back(table, best);
+		}
+	}
+	return output;
+}
+
+
+// exhaustive_max_defense: the subset with the most defense within budget,
+// by trying all 2^N of them. Items are listed in table order.
+template <size_t N>
+constexpr StaticArmorLoadout<N> exhaustive_max_defense_static(const StaticArmorTable<N>& table, double total_cost)
+{
+	uint64_t best_mask = 0;
+	double best_defense = -1.0;
+	for (uint64_t mask = 0; mask < (uint64_t(1) << N); mask++)
+	{
+		double cost = 0, defense = 0;
+		for (uint64_t rest = mask; rest; rest &= rest - 1)
+		{
+			const StaticArmorItem& item = table[__builtin_ctzll(rest)];
+			cost += item.cost;
+			defense += item.defense;
+		}
+		if (cost <= total_cost && defense > best_defense)
+		{
+			best_defense = defense;
+			best_mask = mask;
+		}
+	}
+
+	StaticArmorLoadout<N> output;
+	for (size_t i = 0; i < N; i++)
+	{
+		if (best_mask >> i & 1)
+		{
+			output.push_back(table, i);
+		}
+	}
+	return output;
+}
+
+
+// The rows of table as an ArmorVector, for the runtime solvers.
+template <size_t N>
+std::unique_ptr<ArmorVector> static_armor_vector(const StaticArmorTable<N>& table)
+{
+	std::unique_ptr<ArmorVector> output(new ArmorVector);
+	for (size_t i = 0; i < N; i++)
+	{
+		output->push_back(std::make_shared<ArmorItem>(table[i].description, table[i].cost, table[i].defense));
+	}
+	return output;
+}
+
+
+// The items of loadout, in its order, from armors = static_armor_vector(table).
+template <size_t N>
+std::unique_ptr<ArmorVector> static_loadout_vector(const ArmorVector& armors, const StaticArmorLoadout<N>& loadout)
+{
+	std::unique_ptr<ArmorVector> output(new ArmorVector);
+	for (size_t k = 0; k < loadout.size(); k++)
+	{
+		output->push_back(armors[loadout[k]]);
+	}
+	return output;
+}
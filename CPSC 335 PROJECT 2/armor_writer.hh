@@ -0,0 +1,382 @@
+///////////////////////////////////////////////////////////////////////////////
+// armor_writer.hh
+//
+// Buffered serialisation of armor solutions as text, JSON Lines, or a
+// compact binary format, to a std::ostream or straight to a file descriptor.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+
+#include <unistd.h>
+
+#include "armor_bound.hh"
+#include "maxtime.hh"
+
+
+// Output formats understood by ArmorWriter.
+enum class ArmorFormat
+{
+	// The same human-readable layout as print_armor_vector.
+	text,
+
+	// One JSON object per solution, one solution per line.
+	json_lines,
+
+	// Per solution: a uint32_t item count, then for each item the same record
+	// as a binary snapshot (uint32_t description length, description bytes,
+	// cost and defense doubles), then the total cost and defense as doubles.
+	// Host byte order.
+	binary
+};
+
+// Solutions written with an ArmorSolutionGap also carry its upper bound and
+// relative gap: two more text lines, "upper_bound" and "relative_gap" JSON
+// fields, or two more doubles after the binary totals.
+// JSON has no NaN or infinity, so such values are written as null there.
+
+
+// Convert a format name ("text", "jsonl" or "binary") to an ArmorFormat.
+// Returns false if the name is not recognised.
+bool parse_armor_format(const std::string& name, ArmorFormat& format)
+{
+	if (name == "text")
+	{
+		format = ArmorFormat::text;
+	}
+	else if (name == "jsonl")
+	{
+		format = ArmorFormat::json_lines;
+	}
+	else if (name == "binary")
+	{
+		format = ArmorFormat::binary;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+
+// Serialises many ArmorVector solutions into an in-memory buffer, and writes
+// the buffer out in large blocks instead of flushing every line.
+// Anything still buffered is written out when the writer is destroyed.
+class ArmorWriter
+{
+	//
+	public:
+
+		// Write to the file descriptor fd with write(2), bypassing iostreams.
+		// The descriptor is not closed by the writer.
+		ArmorWriter
+		(
+			int fd,
+			ArmorFormat format,
+			size_t buffer_bytes = 1 << 16
+		)
+			:
+			_fd(fd),
+			_out(nullptr),
+			_format(format),
+			_capacity(buffer_bytes),
+			_ok(true),
+			_bytes_written(0)
+		{
+			assert(fd >= 0);
+			assert(buffer_bytes > 0);
+			_buffer.reserve(buffer_bytes);
+		}
+
+		// Write to the stream out.
+		ArmorWriter
+		(
+			std::ostream& out,
+			ArmorFormat format,
+			size_t buffer_bytes = 1 << 16
+		)
+			:
+			_fd(-1),
+			_out(&out),
+			_format(format),
+			_capacity(buffer_bytes),
+			_ok(true),
+			_bytes_written(0)
+		{
+			assert(buffer_bytes > 0);
+			_buffer.reserve(buffer_bytes);
+		}
+
+		ArmorWriter(const ArmorWriter&) = delete;
+		ArmorWriter& operator=(const ArmorWriter&) = delete;
+
+		~ArmorWriter() { flush(); }
+
+		// Append one solution to the output.
+		void write(const ArmorVector& armors)
+		{
+			write_solution(armors, nullptr);
+		}
+
+		// Append one solution and its optimality gap to the output.
+		void write(const ArmorVector& armors, const ArmorSolutionGap& gap)
+		{
+			write_solution(armors, &gap);
+		}
+
+		// Append raw, already formatted bytes, e.g. a separator line.
+		void write_raw(const std::string& bytes)
+		{
+			_buffer += bytes;
+			if (_buffer.size() >= _capacity)
+			{
+				flush();
+			}
+		}
+
+		// Write out everything buffered so far.
+		// Returns false if any write so far has failed.
+		bool flush()
+		{
+			if (_buffer.empty() || ! _ok)
+			{
+				_buffer.clear();
+				return _ok;
+			}
+
+			if (_out)
+			{
+				_out->write(_buffer.data(), _buffer.size());
+				_out->flush();
+				_ok = bool(*_out);
+			}
+			else
+			{
+				const char* data = _buffer.data();
+				size_t remaining = _buffer.size();
+				while (remaining > 0)
+				{
+					ssize_t n = ::write(_fd, data, remaining);
+					if (n < 0 && errno == EINTR)
+					{
+						continue;
+					}
+					if (n <= 0)
+					{
+						_ok = false;
+						break;
+					}
+					data += n;
+					remaining -= n;
+				}
+			}
+
+			if (_ok)
+			{
+				_bytes_written += _buffer.size();
+			}
+			_buffer.clear();
+			return _ok;
+		}
+
+		// Total bytes successfully written out, not counting the buffer.
+		size_t bytes_written() const { return _bytes_written; }
+
+	//
+	private:
+
+		void write_solution(const ArmorVector& armors, const ArmorSolutionGap* gap)
+		{
+			double total_cost, total_defense;
+			sum_armor_vector(armors, total_cost, total_defense);
+
+			switch (_format)
+			{
+				case ArmorFormat::text:
+					write_text(armors, total_cost, total_defense);
+					if (gap)
+					{
+						_buffer += "> Upper bound on defense: ";
+						append_number(gap->upper_bound, "%g");
+						_buffer += "\n> Optimality gap: ";
+						append_number(gap->relative() * 100, "%g");
+						_buffer += "%\n";
+					}
+					break;
+
+				case ArmorFormat::json_lines:
+					write_json(armors, total_cost, total_defense, gap);
+					break;
+
+				case ArmorFormat::binary:
+					write_binary(armors, total_cost, total_defense);
+					if (gap)
+					{
+						double upper_bound = gap->upper_bound, relative = gap->relative();
+						append_raw(&upper_bound, sizeof(upper_bound));
+						append_raw(&relative, sizeof(relative));
+					}
+					break;
+			}
+
+			if (_buffer.size() >= _capacity)
+			{
+				flush();
+			}
+		}
+
+		void write_text(const ArmorVector& armors, double total_cost, double total_defense)
+		{
+			_buffer += "*** Armor Vector ***\n";
+
+			if (armors.empty())
+			{
+				_buffer += "[empty armor list]\n";
+				return;
+			}
+
+			for (auto& armor : armors)
+			{
+				_buffer += "Ye olde ";
+				_buffer += armor->description();
+				_buffer += " ==> Cost of ";
+				append_number(armor->cost(), "%g");
+				_buffer += " gold; Defense points = ";
+				append_number(armor->defense(), "%g");
+				_buffer += '\n';
+			}
+
+			_buffer += "> Grand total cost: ";
+			append_number(total_cost, "%g");
+			_buffer += " gold\n> Grand total defense: ";
+			append_number(total_defense, "%g");
+			_buffer += '\n';
+		}
+
+		void write_json(const ArmorVector& armors, double total_cost, double total_defense, const ArmorSolutionGap* gap)
+		{
+			_buffer += "{\"items\":[";
+			for (size_t i = 0; i < armors.size(); i++)
+			{
+				if (i > 0)
+				{
+					_buffer += ',';
+				}
+				_buffer += "{\"description\":";
+				append_json_string(armors[i]->description());
+				_buffer += ",\"cost\":";
+				append_json_number(armors[i]->cost());
+				_buffer += ",\"defense\":";
+				append_json_number(armors[i]->defense());
+				_buffer += '}';
+			}
+			_buffer += "],\"total_cost\":";
+			append_json_number(total_cost);
+			_buffer += ",\"total_defense\":";
+			append_json_number(total_defense);
+			if (gap)
+			{
+				_buffer += ",\"upper_bound\":";
+				append_json_number(gap->upper_bound);
+				_buffer += ",\"relative_gap\":";
+				append_json_number(gap->relative());
+			}
+			_buffer += "}\n";
+		}
+
+		void write_binary(const ArmorVector& armors, double total_cost, double total_defense)
+		{
+			uint32_t count = armors.size();
+			append_raw(&count, sizeof(count));
+			for (auto& armor : armors)
+			{
+				uint32_t length = armor->description().size();
+				double cost = armor->cost(), defense = armor->defense();
+				append_raw(&length, sizeof(length));
+				append_raw(armor->description().data(), length);
+				append_raw(&cost, sizeof(cost));
+				append_raw(&defense, sizeof(defense));
+			}
+			append_raw(&total_cost, sizeof(total_cost));
+			append_raw(&total_defense, sizeof(total_defense));
+		}
+
+		// printf-style formatting matches the default std::ostream output for "%g".
+		void append_number(double value, const char* format)
+		{
+			char digits[32];
+			int n = std::snprintf(digits, sizeof(digits), format, value);
+			_buffer.append(digits, n);
+		}
+
+		// A JSON number in "%.15g", or null if value is NaN or infinite.
+		void append_json_number(double value)
+		{
+			if (std::isfinite(value))
+			{
+				append_number(value, "%.15g");
+			}
+			else
+			{
+				_buffer += "null";
+			}
+		}
+
+		void append_raw(const void* bytes, size_t size)
+		{
+			_buffer.append(static_cast<const char*>(bytes), size);
+		}
+
+		void append_json_string(const std::string& value)
+		{
+			_buffer += '"';
+			for (char c : value)
+			{
+				if (c == '"' || c == '\\')
+				{
+					_buffer += '\\';
+					_buffer += c;
+				}
+				else if (static_cast<unsigned char>(c) < 0x20)
+				{
+					char escaped[8];
+					std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+					_buffer += escaped;
+				}
+				else
+				{
+					_buffer += c;
+				}
+			}
+			_buffer += '"';
+		}
+
+		// Destination file descriptor, or -1 when writing to _out.
+		int _fd;
+
+		// Destination stream, or nullptr when writing to _fd.
+		std::ostream* _out;
+
+		ArmorFormat _format;
+
+		// The buffer is written out once it holds at least this many bytes.
+		size_t _capacity;
+
+		std::string _buffer;
+
+		// False once a write has failed; later output is discarded.
+		bool _ok;
+
+		size_t _bytes_written;
+};
@@ -0,0 +1,246 @@
+///////////////////////////////////////////////////////////////////////////////
+// gzip_stream.hh
+//
+// Read a gzip-compressed file through a std::streambuf, with decompression
+// running on a background thread so that it overlaps with whatever the
+// reading thread does with the data, such as parsing.
+//
+// Requires zlib; link with -lz -pthread.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+
+// Bounded single-producer, single-consumer byte queue.
+// The writer blocks while the ring is full and the reader blocks while it is
+// empty, so a fast producer can never run more than capacity bytes ahead.
+class ByteRingBuffer
+{
+	//
+	public:
+
+		//
+		explicit ByteRingBuffer(size_t capacity)
+			:
+			_data(capacity),
+			_head(0),
+			_size(0),
+			_closed(false),
+			_cancelled(false),
+			_ok(true)
+		{
+			assert(capacity > 0);
+		}
+
+		// Queue size bytes, blocking until there is room.
+		// Returns false if the reader cancelled, in which case the writer should stop.
+		bool write(const char* data, size_t size)
+		{
+			while (size > 0)
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_not_full.wait(lock, [&]() { return _size < _data.size() || _cancelled; });
+				if (_cancelled)
+				{
+					return false;
+				}
+
+				size_t tail = (_head + _size) % _data.size();
+				size_t n = std::min({ size, _data.size() - _size, _data.size() - tail });
+				std::memcpy(&_data[tail], data, n);
+				_size += n;
+				data += n;
+				size -= n;
+				_not_empty.notify_one();
+			}
+			return true;
+		}
+
+		// Dequeue up to size bytes, blocking until at least one is available.
+		// Returns 0 once the writer has closed the ring and it has been drained.
+		size_t read(char* data, size_t size)
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			_not_empty.wait(lock, [&]() { return _size > 0 || _closed; });
+
+			size_t n = std::min({ size, _size, _data.size() - _head });
+			std::memcpy(data, &_data[_head], n);
+			_head = (_head + n) % _data.size();
+			_size -= n;
+			_not_full.notify_one();
+			return n;
+		}
+
+		// Called by the writer when there is no more data; ok is false if the
+		// data ended because of an error.
+		void close(bool ok)
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_closed = true;
+			_ok = ok;
+			_not_empty.notify_one();
+		}
+
+		// Called by the reader to stop the writer early.
+		void cancel()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_cancelled = true;
+			_not_full.notify_one();
+		}
+
+		// False if the writer closed the ring because of an error.
+		bool ok()
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _ok;
+		}
+
+	//
+	private:
+
+		std::vector<char> _data;
+
+		// Index of the oldest queued byte, and the number of queued bytes.
+		size_t _head, _size;
+
+		bool _closed, _cancelled, _ok;
+
+		std::mutex _mutex;
+		std::condition_variable _not_empty, _not_full;
+};
+
+
+// A std::streambuf over the decompressed contents of a gzip file.
+// A background thread inflates the file into a ring buffer while the
+// thread reading from the streambuf consumes it, so total time is roughly the
+// slower of decompression and the reader's own work rather than their sum.
+// Files that are not gzip-compressed are passed through unchanged.
+class GzipInputBuffer : public std::streambuf
+{
+	//
+	public:
+
+		// Open path and start decompressing it.
+		// ring_bytes bounds how far decompression may run ahead of the reader.
+		GzipInputBuffer
+		(
+			const std::string& path,
+			size_t ring_bytes = 1 << 20,
+			size_t read_bytes = 1 << 16
+		)
+			:
+			_file(gzopen(path.c_str(), "rb")),
+			_ring(ring_bytes),
+			_get_area(read_bytes)
+		{
+			assert(read_bytes > 0);
+			setg(_get_area.data(), _get_area.data(), _get_area.data());
+
+			if ( ! _file )
+			{
+				_ring.close(false);
+				return;
+			}
+
+			gzbuffer(_file, read_bytes);
+			_inflater = std::thread([this, read_bytes]() { inflate_all(read_bytes); });
+		}
+
+		GzipInputBuffer(const GzipInputBuffer&) = delete;
+		GzipInputBuffer& operator=(const GzipInputBuffer&) = delete;
+
+		// Stops decompression if the reader has not consumed everything.
+		~GzipInputBuffer()
+		{
+			_ring.cancel();
+			if (_inflater.joinable())
+			{
+				_inflater.join();
+			}
+			if (_file)
+			{
+				gzclose(_file);
+			}
+		}
+
+		// False if the file could not be opened.
+		bool is_open() const { return _file != nullptr; }
+
+		// False if the file could not be opened or is corrupt.
+		// Only meaningful once the reader has reached end of file.
+		bool ok() { return _ring.ok(); }
+
+	//
+	protected:
+
+		int_type underflow() override
+		{
+			if (gptr() < egptr())
+			{
+				return traits_type::to_int_type(*gptr());
+			}
+
+			size_t n = _ring.read(_get_area.data(), _get_area.size());
+			if (n == 0)
+			{
+				return traits_type::eof();
+			}
+
+			setg(_get_area.data(), _get_area.data(), _get_area.data() + n);
+			return traits_type::to_int_type(*gptr());
+		}
+
+	//
+	private:
+
+		// Body of the decompression thread.
+		void inflate_all(size_t read_bytes)
+		{
+			std::vector<char> block(read_bytes);
+			for (;;)
+			{
+				int n = gzread(_file, block.data(), block.size());
+				if (n < 0)
+				{
+					_ring.close(false);
+					return;
+				}
+				if (n == 0)
+				{
+					int error = Z_OK;
+					gzerror(_file, &error);
+					_ring.close(error == Z_OK || error == Z_STREAM_END);
+					return;
+				}
+				if ( ! _ring.write(block.data(), n) )
+				{
+					return;
+				}
+			}
+		}
+
+		gzFile _file;
+
+		ByteRingBuffer _ring;
+
+		// Decompressed bytes handed to the reader, refilled from _ring.
+		std::vector<char> _get_area;
+
+		std::thread _inflater;
+};
@@ -10,9 +10,13 @@
 #pragma once
 
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <queue>
@@ -20,6 +24,14 @@
 #include <string>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "armor_generic.hh"
+#include "gzip_stream.hh"
+
 
 // One armor item available for purchase.
 class ArmorItem
@@ -66,89 +78,486 @@ class ArmorItem
 typedef std::vector<std::shared_ptr<ArmorItem>> ArmorVector;
 
 
-// Load all the valid armor items from the CSV database
-// Armor items that are missing fields, or have invalid values, are skipped.
-// Returns nullptr on I/O error.
-std::unique_ptr<ArmorVector> load_armor_database(const std::string& path)
+// Items of an ArmorVector, as an access policy for armor_generic.hh.
+struct ArmorVectorAccess
+{
+	const ArmorVector& armors;
+
+	size_t size() const { return armors.size(); }
+	double cost(size_t i) const { return armors[i]->cost(); }
+	double defense(size_t i) const { return armors[i]->defense(); }
+};
+
+
+// The ArmorVector items at indexes, for solvers run on ArmorVectorAccess.
+std::unique_ptr<ArmorVector> armor_indexes_vector(const ArmorVector& armors, const std::vector<uint32_t>& indexes)
+{
+	std::unique_ptr<ArmorVector> output(new ArmorVector);
+	for (uint32_t i : indexes)
+	{
+		output->push_back(armors[i]);
+	}
+	return output;
+}
+
+
+// Outcome of parsing one data row of the armor database.
+enum class ArmorLineStatus
+{
+	parsed,		// the row was valid and output holds the new item
+	skipped,	// the row has invalid values and is ignored
+	malformed	// the row has the wrong number of fields; the database is corrupt
+};
+
+
+// Parse one '^'-separated data row of the CSV armor database.
+// line_number is only used for error messages.
+// On ArmorLineStatus::parsed the new item is stored in output.
+ArmorLineStatus parse_armor_line
+(
+	const std::string& line,
+	size_t line_number,
+	std::shared_ptr<ArmorItem>& output
+)
 {
-	std::unique_ptr<ArmorVector> failure(nullptr);
+	std::vector<std::string> fields;
+	std::stringstream ss(line);
+
+	for (std::string field; std::getline(ss, field, '^'); )
+	{
+		fields.push_back(field);
+	}
 
-	std::ifstream f(path);
+	if (fields.size() != 3)
+	{
+		std::cout
+			<< "Failed to load armor database: Invalid field count at line " << line_number << "; Want 3 but got " << fields.size() << std::endl
+			<< "Line: " << line << std::endl
+			;
+		return ArmorLineStatus::malformed;
+	}
+
+	std::string
+		descr_field = fields[0],
+		cost_gold_field = fields[1],
+		defense_points_field = fields[2]
+		;
+
+	auto parse_dbl = [](const std::string& field, double& output)
+	{
+		std::stringstream ss(field);
+		if ( ! ss )
+		{
+			return false;
+		}
+
+		ss >> output;
+
+		return true;
+	};
+
+	std::string description(descr_field);
+	double cost_gold, defense_points;
+	if (
+		parse_dbl(cost_gold_field, cost_gold)
+		&& parse_dbl(defense_points_field, defense_points)
+	)
+	{
+		output = std::shared_ptr<ArmorItem>(
+			new ArmorItem(
+				description,
+				cost_gold,
+				defense_points
+			)
+		);
+		return ArmorLineStatus::parsed;
+	}
+
+	return ArmorLineStatus::skipped;
+}
+
+
+// Magic bytes at the start of a binary armor snapshot.
+// A snapshot is the magic, a uint64_t item count, then per item:
+// a uint32_t description length, the description bytes, and the cost and
+// defense as doubles. Integers and doubles are in host byte order.
+const char ARMOR_SNAPSHOT_MAGIC[8] = { 'A', 'R', 'M', 'O', 'R', 'S', 'N', '1' };
+
+
+// Write armors to path as a binary snapshot, which can be scanned or loaded
+// much faster than the CSV since no text parsing is needed.
+// Returns false on I/O error.
+bool save_armor_snapshot(const ArmorVector& armors, const std::string& path)
+{
+	std::ofstream f(path, std::ios::binary | std::ios::trunc);
 	if (!f)
 	{
-		std::cout << "Failed to load armor database; Cannot open file: " << path << std::endl;
-		return failure;
+		std::cout << "Failed to save armor snapshot; Cannot open file: " << path << std::endl;
+		return false;
 	}
 
-	std::unique_ptr<ArmorVector> result(new ArmorVector);
+	uint64_t count = armors.size();
+	f.write(ARMOR_SNAPSHOT_MAGIC, sizeof(ARMOR_SNAPSHOT_MAGIC));
+	f.write(reinterpret_cast<const char*>(&count), sizeof(count));
 
-	size_t line_number = 0;
-	for (std::string line; std::getline(f, line); )
+	for (auto& armor : armors)
 	{
-		line_number++;
+		uint32_t length = armor->description().size();
+		double cost = armor->cost(), defense = armor->defense();
+		f.write(reinterpret_cast<const char*>(&length), sizeof(length));
+		f.write(armor->description().data(), length);
+		f.write(reinterpret_cast<const char*>(&cost), sizeof(cost));
+		f.write(reinterpret_cast<const char*>(&defense), sizeof(defense));
+	}
 
-		// First line is a header row
-		if ( line_number == 1 )
+	return bool(f);
+}
+
+
+// A binary snapshot written by save_armor_snapshot, mapped into memory and
+// read in place, as an access policy for armor_generic.hh. Opening finds
+// where each item's record starts; nothing else is copied.
+class ArmorSnapshotMap
+{
+	//
+	public:
+
+		ArmorSnapshotMap() : _data(nullptr), _length(0) { }
+
+		ArmorSnapshotMap(const ArmorSnapshotMap&) = delete;
+		ArmorSnapshotMap& operator=(const ArmorSnapshotMap&) = delete;
+
+		~ArmorSnapshotMap() { close(); }
+
+		// Returns false on I/O error or if path is not a complete snapshot.
+		bool open(const std::string& path)
 		{
-			continue;
+			close();
+
+			int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+			struct stat status;
+			if (fd < 0 || fstat(fd, &status) != 0)
+			{
+				std::cout << "Failed to map armor snapshot; Cannot open file: " << path << std::endl;
+				if (fd >= 0)
+				{
+					::close(fd);
+				}
+				return false;
+			}
+
+			_length = status.st_size;
+			void* data = _length ? mmap(nullptr, _length, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+			::close(fd);
+			if (data == MAP_FAILED)
+			{
+				std::cout << "Failed to map armor snapshot; Cannot map file: " << path << std::endl;
+				_length = 0;
+				return false;
+			}
+			_data = static_cast<const char*>(data);
+
+			const size_t magic_size = sizeof(ARMOR_SNAPSHOT_MAGIC);
+			uint64_t count = 0;
+			bool valid = _length >= magic_size + sizeof(count)
+				&& std::equal(_data, _data + magic_size, ARMOR_SNAPSHOT_MAGIC);
+			size_t offset = magic_size + sizeof(count);
+			if (valid)
+			{
+				std::memcpy(&count, _data + magic_size, sizeof(count));
+			}
+			for (uint64_t i = 0; valid && i < count; i++)
+			{
+				uint32_t length;
+				valid = _length - offset >= sizeof(length);
+				if (valid)
+				{
+					std::memcpy(&length, _data + offset, sizeof(length));
+					valid = _length - offset - sizeof(length) >= length + 2 * sizeof(double);
+				}
+				if (valid)
+				{
+					_records.push_back(offset);
+					offset += sizeof(length) + length + 2 * sizeof(double);
+				}
+			}
+
+			if ( ! valid )
+			{
+				std::cout << "Failed to map armor snapshot; Truncated or invalid file: " << path << std::endl;
+				close();
+				return false;
+			}
+			return true;
 		}
 
-		std::vector<std::string> fields;
-		std::stringstream ss(line);
+		void close()
+		{
+			if (_data)
+			{
+				munmap(const_cast<char*>(_data), _length);
+			}
+			_data = nullptr;
+			_length = 0;
+			_records.clear();
+		}
 
-		for (std::string field; std::getline(ss, field, '^'); )
+		size_t size() const { return _records.size(); }
+
+		std::string description(size_t i) const
 		{
-			fields.push_back(field);
+			uint32_t length;
+			std::memcpy(&length, _data + _records[i], sizeof(length));
+			return std::string(_data + _records[i] + sizeof(length), length);
 		}
 
-		if (fields.size() != 3)
+		double cost(size_t i) const { return read_double(i, 0); }
+		double defense(size_t i) const { return read_double(i, 1); }
+
+	//
+	private:
+
+		// Field 0 is the cost and 1 the defense, after the description.
+		double read_double(size_t i, int field) const
 		{
-			std::cout
-				<< "Failed to load armor database: Invalid field count at line " << line_number << "; Want 3 but got " << fields.size() << std::endl
-				<< "Line: " << line << std::endl
-				;
-			return failure;
+			uint32_t length;
+			std::memcpy(&length, _data + _records[i], sizeof(length));
+			double value;
+			std::memcpy(&value, _data + _records[i] + sizeof(length) + length + field * sizeof(double), sizeof(value));
+			return value;
 		}
 
-		std::string
-			descr_field = fields[0],
-			cost_gold_field = fields[1],
-			defense_points_field = fields[2]
-			;
+		const char* _data;
+		size_t _length;
+		std::vector<size_t> _records;
+};
+
+
+// Callback that receives each chunk of consecutive armor items read by
+// scan_armor_database. Return false to stop the scan early.
+typedef std::function<bool(const ArmorVector&)> ArmorChunkVisitor;
+
+
+// Stream an armor database from f, which may hold either the CSV format or a
+// binary snapshot, and pass its valid items to visit in chunks of at most
+// chunk_rows items, in order. path is only used for error messages.
+// f is read strictly sequentially, so it may be a pipe or decompressor.
+// Returns false on I/O error or a corrupt database; stopping early is not an error.
+bool scan_armor_stream
+(
+	std::istream& f,
+	const std::string& path,
+	size_t chunk_rows,
+	const ArmorChunkVisitor& visit
+)
+{
+	assert(chunk_rows > 0);
+
+	ArmorVector chunk;
+	chunk.reserve(chunk_rows);
+
+	// Returns false once the visitor asks to stop.
+	auto flush_chunk = [&]()
+	{
+		if ( chunk.empty() )
+		{
+			return true;
+		}
+		bool more = visit(chunk);
+		chunk.clear();
+		return more;
+	};
+
+	char magic[sizeof(ARMOR_SNAPSHOT_MAGIC)] = { 0 };
+	f.read(magic, sizeof(magic));
+	bool is_snapshot = f.gcount() == sizeof(magic)
+		&& std::equal(magic, magic + sizeof(magic), ARMOR_SNAPSHOT_MAGIC);
 
-		auto parse_dbl = [](const std::string& field, double& output)
+	if (is_snapshot)
+	{
+		uint64_t count = 0;
+		f.read(reinterpret_cast<char*>(&count), sizeof(count));
+
+		std::string description;
+		for (uint64_t i = 0; i < count && f; i++)
 		{
-			std::stringstream ss(field);
-			if ( ! ss )
+			uint32_t length = 0;
+			double cost = 0, defense = 0;
+			f.read(reinterpret_cast<char*>(&length), sizeof(length));
+			description.resize(length);
+			f.read(&description[0], length);
+			f.read(reinterpret_cast<char*>(&cost), sizeof(cost));
+			f.read(reinterpret_cast<char*>(&defense), sizeof(defense));
+			if ( ! f )
 			{
-				return false;
+				break;
 			}
 
-			ss >> output;
+			chunk.push_back(std::shared_ptr<ArmorItem>(new ArmorItem(description, cost, defense)));
+			if (chunk.size() == chunk_rows && ! flush_chunk())
+			{
+				return true;
+			}
+		}
+
+		if ( ! f )
+		{
+			std::cout << "Failed to load armor snapshot; Truncated file: " << path << std::endl;
+			return false;
+		}
+
+		flush_chunk();
+		return true;
+	}
 
+	// Not a snapshot, so the bytes read while checking for the magic are the
+	// start of the CSV header row.
+	std::string carry(magic, f.gcount());
+	f.clear();
+
+	auto next_line = [&](std::string& line)
+	{
+		size_t newline = carry.find('\n');
+		if (newline != std::string::npos)
+		{
+			line = carry.substr(0, newline);
+			carry.erase(0, newline + 1);
 			return true;
-		};
+		}
 
-		std::string description(descr_field);
-		double cost_gold, defense_points;
-		if (
-			parse_dbl(cost_gold_field, cost_gold)
-			&& parse_dbl(defense_points_field, defense_points)
-		)
+		std::string rest;
+		if ( ! std::getline(f, rest) && carry.empty() )
+		{
+			return false;
+		}
+		line = carry + rest;
+		carry.clear();
+		return true;
+	};
+
+	size_t line_number = 0;
+	for (std::string line; next_line(line); )
+	{
+		line_number++;
+
+		// First line is a header row
+		if ( line_number == 1 )
 		{
-			result->push_back(
-				std::shared_ptr<ArmorItem>(
-					new ArmorItem(
-						description,
-						cost_gold,
-						defense_points
-					)
-				)
-			);
+			continue;
 		}
+
+		std::shared_ptr<ArmorItem> armor;
+		switch (parse_armor_line(line, line_number, armor))
+		{
+			case ArmorLineStatus::parsed:
+				chunk.push_back(armor);
+				if (chunk.size() == chunk_rows && ! flush_chunk())
+				{
+					return true;
+				}
+				break;
+
+			case ArmorLineStatus::skipped:
+				break;
+
+			case ArmorLineStatus::malformed:
+				return false;
+		}
+	}
+
+	flush_chunk();
+	return true;
+}
+
+
+// Stream the armor database at path, which may be either the CSV format or a
+// binary snapshot, optionally gzip-compressed, and pass its valid items to
+// visit in chunks of at most chunk_rows items, in file order.
+// Only one chunk is held in memory at a time, so this works on databases that
+// do not fit in RAM. When visit returns false nothing more is read from the
+// file, so prefix queries only touch the start of it.
+// Compressed files are inflated on a background thread while this thread
+// parses, see GzipInputBuffer.
+// Returns false on I/O error or a corrupt database; stopping early is not an error.
+bool scan_armor_database
+(
+	const std::string& path,
+	size_t chunk_rows,
+	const ArmorChunkVisitor& visit
+)
+{
+	std::ifstream f(path, std::ios::binary);
+	if (!f)
+	{
+		std::cout << "Failed to load armor database; Cannot open file: " << path << std::endl;
+		return false;
+	}
+
+	char magic[2] = { 0 };
+	f.read(magic, sizeof(magic));
+	bool is_gzip = f.gcount() == 2 && magic[0] == '\x1f' && magic[1] == '\x8b';
+
+	if ( ! is_gzip )
+	{
+		f.clear();
+		f.seekg(0);
+		return scan_armor_stream(f, path, chunk_rows, visit);
 	}
 
 	f.close();
+	GzipInputBuffer inflated(path);
+	if ( ! inflated.is_open() )
+	{
+		std::cout << "Failed to load armor database; Cannot open file: " << path << std::endl;
+		return false;
+	}
+
+	std::istream in(&inflated);
+	bool stopped_early = false;
+	bool ok = scan_armor_stream(
+		in,
+		path,
+		chunk_rows,
+		[&](const ArmorVector& chunk)
+		{
+			stopped_early = ! visit(chunk);
+			return ! stopped_early;
+		}
+	);
+
+	// A scan that stopped early never reached the end of the compressed data,
+	// so it cannot have seen a decompression error.
+	if (ok && ! stopped_early && ! inflated.ok())
+	{
+		std::cout << "Failed to load armor database; Corrupt gzip file: " << path << std::endl;
+		return false;
+	}
+	return ok;
+}
+
+
+// Load all the valid armor items from the CSV database, or a binary snapshot
+// written by save_armor_snapshot. Either may be gzip-compressed.
+// Armor items that are missing fields, or have invalid values, are skipped.
+// Returns nullptr on I/O error.
+std::unique_ptr<ArmorVector> load_armor_database(const std::string& path)
+{
+	std::unique_ptr<ArmorVector> result(new ArmorVector);
+
+	bool ok = scan_armor_database(
+		path,
+		4096,
+		[&](const ArmorVector& chunk)
+		{
+			result->insert(result->end(), chunk.begin(), chunk.end());
+			return true;
+		}
+	);
+
+	if ( ! ok )
+	{
+		return std::unique_ptr<ArmorVector>(nullptr);
+	}
 
 	return result;
 }
@@ -175,13 +584,15 @@ void sum_armor_vector
 
 // Convenience function to print out each ArmorItem in an ArmorVector,
 // followed by the total kilocalories and protein in it.
+// stdout is flushed once at the end rather than after every line; use
+// ArmorWriter (armor_writer.hh) to dump many solutions efficiently.
 void print_armor_vector(const ArmorVector& armors)
 {
-	std::cout << "*** Armor Vector ***" << std::endl;
+	std::cout << "*** Armor Vector ***" << '\n';
 
 	if ( armors.size() == 0 )
 	{
-		std::cout << "[empty armor list]" << std::endl;
+		std::cout << "[empty armor list]" << '\n';
 	}
 	else
 	{
@@ -192,18 +603,34 @@ void print_armor_vector(const ArmorVector& armors)
 				<< " ==> "
 				<< "Cost of " << armor->cost() << " gold"
 				<< "; Defense points = " << armor->defense()
-				<< std::endl
+				<< '\n'
 				;
 		}
 
 		double total_cost, total_defense;
 		sum_armor_vector(armors, total_cost, total_defense);
 		std::cout
-			<< "> Grand total cost: " << total_cost << " gold" << std::endl
+			<< "> Grand total cost: " << total_cost << " gold" << '\n'
 			<< "> Grand total defense: " << total_defense
-			<< std::endl
+			<< '\n'
 			;
 	}
+
+	std::cout.flush();
+}
+
+
+// The filter_armor_vector criteria for a single armor item:
+// positive defense, between min_defense and max_defense (inclusive).
+bool armor_matches_filter
+(
+	const ArmorItem& armor,
+	double min_defense,
+	double max_defense
+)
+{
+	double d = armor.defense();
+	return d > 0 && d >= min_defense && d <= max_defense;
 }
 
 
@@ -234,9 +661,8 @@ std::unique_ptr<ArmorVector> filter_armor_vector
 
 	for (auto& armor : source)
     {
-        double d = armor->defense();
         // condition check to belong in the output
-        if (d > 0 && d >= min_defense && d <= max_defense && current_size < total_size)
+        if (armor_matches_filter(*armor, min_defense, max_defense) && current_size < total_size)
         {
             current_size++;
             output.push_back(std::shared_ptr<ArmorItem>(new ArmorItem(armor->description(), armor->cost(), armor->defense())));
@@ -244,6 +670,53 @@ std::unique_ptr<ArmorVector> filter_armor_vector
     }
 
 	return std::make_unique<ArmorVector>(output);
+}
+
+// Out-of-core counterpart of filter_armor_vector: stream the database at path
+// (CSV or binary snapshot) in chunks of chunk_rows items and keep only the
+// first total_size items that match the same criteria, in file order.
+// Memory use is bounded by one chunk plus the matching items, so the whole
+// database never needs to be loaded.
+// Reading stops as soon as total_size matching items have been found, and
+// chunks are never larger than total_size, so small queries only parse the
+// first few KB of the file.
+// Returns nullptr on I/O error.
+std::unique_ptr<ArmorVector> filter_armor_database
+(
+	const std::string& path,
+	double min_defense,
+	double max_defense,
+	int total_size,
+	size_t chunk_rows = 4096
+)
+{
+	std::unique_ptr<ArmorVector> output(new ArmorVector);
+
+	size_t wanted = std::max(total_size, 0);
+	chunk_rows = std::max<size_t>(1, std::min(chunk_rows, wanted));
+
+	bool ok = scan_armor_database(
+		path,
+		chunk_rows,
+		[&](const ArmorVector& chunk)
+		{
+			for (auto& armor : chunk)
+			{
+				if (output->size() < wanted && armor_matches_filter(*armor, min_defense, max_defense))
+				{
+					output->push_back(armor);
+				}
+			}
+			return output->size() < wanted;
+		}
+	);
+
+	if ( ! ok )
+	{
+		return std::unique_ptr<ArmorVector>(nullptr);
+	}
+
+	return output;
 }
 
 // return a binary of a number 'num' of a fixed length 'len'
@@ -280,44 +753,7 @@ std::unique_ptr<ArmorVector> greedy_max_defense
 	double total_cost
 )
 {
-	// declaring a new ArmorVector to return
-	ArmorVector output;
-	ArmorVector source = armors;
-    double current_cost = 0.0;
-    while(!source.empty())
-    {
-        // variable to set the minimum value
-        int loop_pos = 0;
-        double max_ratio = 0;
-        int optimal_choice_pos = 0;
-        //getting maximum value
-        for (auto& armor : source)
-        {
-            if(loop_pos == 0)
-            {
-                max_ratio = armor->defense() / armor->cost();
-                optimal_choice_pos = loop_pos;
-                loop_pos++;
-                continue;
-            }
-            double cur_ratio = armor->defense() / armor->cost();
-            if(cur_ratio > max_ratio)
-            {
-                max_ratio = cur_ratio;
-                optimal_choice_pos = loop_pos;
-            }
-            loop_pos++;
-        }
-        // check fitting condition
-        if(current_cost + source[optimal_choice_pos]->cost() <= total_cost)
-        {
-            current_cost += source[optimal_choice_pos]->cost();
-            output.push_back(source[optimal_choice_pos]);
-        }
-        source.erase(source.begin() + optimal_choice_pos);
-    }
-
-	return std::make_unique<ArmorVector>(output);
+	return armor_indexes_vector(armors, greedy_max_defense_generic<double>(ArmorVectorAccess{ armors }, total_cost));
 }
 
 
@@ -332,41 +768,8 @@ std::unique_ptr<ArmorVector> exhaustive_max_defense
 	double total_cost
 )
 {
-	const int n = armors.size();
-	assert(n < 64);
-
-    // variables
-    double best_defense = -1.0, current_cost = -1.0, current_defense = -1.0;
-    std::string best_set = "";
-	// size of power set
-	int pn = 1;
-	for(int i = 0; i < n; i++) pn *= 2;
-	// calculating results for all the subsets
-	for(int i = 0; i < pn; i++)
-    {
-        // calculating result for a subset
-        std::string bitmask_string = get_binary(i, n);
-        current_defense = 0.0;
-        current_cost = 0.0;
-        for(int j = 0; j < n; j++) if(bitmask_string[j] == '1')
-        {
-            current_cost += armors[j]->cost();
-            current_defense += armors[j]->defense();
-        }
-        // filtering the optimal option
-        if(current_cost <= total_cost && current_defense > best_defense)
-        {
-            best_defense = current_defense;
-            best_set = bitmask_string;
-        }
-    }
-    // creating output vector
-    ArmorVector output;
-    for(int i = 0; i < n; i++) if(best_set[i] == '1')
-    {
-        output.push_back(armors[i]);
-    }
-	return std::make_unique<ArmorVector>(output);
+	assert(armors.size() < 64);
+	return armor_indexes_vector(armors, exhaustive_max_defense_generic<double>(ArmorVectorAccess{ armors }, total_cost));
 }
 
 
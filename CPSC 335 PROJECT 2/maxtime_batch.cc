@@ -0,0 +1,88 @@
+///////////////////////////////////////////////////////////////////////////////
+// maxtime_batch.cc
+//
+// Answer a whole file of queries against one load of the armor catalogue.
+//
+// Usage: batch QUERIES [CATALOGUE [FORMAT [THREADS]]]
+//	QUERIES is a query file, see load_armor_queries in armor_batch.hh.
+//	CATALOGUE defaults to ride.csv, and may also be a binary snapshot.
+//	FORMAT is text (default), jsonl or binary; see armor_writer.hh.
+//	THREADS defaults to the number of hardware threads; if given, it must be
+//	a whole number from 1 to 4096.
+// Solutions are written to stdout in query order, each with the Dantzig
+// upper bound of its query and its optimality gap against it.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "armor_batch.hh"
+#include "armor_writer.hh"
+#include "maxtime.hh"
+
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2 || argc > 5)
+	{
+		std::cerr << "Usage: " << argv[0] << " QUERIES [CATALOGUE [FORMAT [THREADS]]]" << std::endl;
+		return 2;
+	}
+
+	std::string
+		queries_path = argv[1],
+		catalogue_path = argc > 2 ? argv[2] : "ride.csv",
+		format_name = argc > 3 ? argv[3] : "text"
+		;
+
+	ArmorFormat format;
+	if ( ! parse_armor_format(format_name, format) )
+	{
+		std::cerr << "Unknown output format: " << format_name << std::endl;
+		return 2;
+	}
+
+	unsigned thread_count = std::thread::hardware_concurrency();
+	if (argc > 4)
+	{
+		// A positive whole number and nothing else.
+		std::stringstream digits(argv[4]);
+		long parsed;
+		char trailing;
+		if ( ! (digits >> parsed) || digits >> trailing || parsed <= 0 || parsed > 4096 )
+		{
+			std::cerr << "Invalid thread count: " << argv[4] << std::endl;
+			return 2;
+		}
+		thread_count = parsed;
+	}
+
+	auto queries = load_armor_queries(queries_path);
+	if ( ! queries )
+	{
+		return 1;
+	}
+
+	auto all_armors = load_armor_database(catalogue_path);
+	if ( ! all_armors )
+	{
+		return 1;
+	}
+
+	ArmorWriter writer(STDOUT_FILENO, format);
+	solve_armor_queries(
+		*all_armors,
+		*queries,
+		thread_count,
+		[&](size_t, const ArmorVector& solution, const ArmorSolveContext& context)
+		{
+			writer.write(solution, context.gap);
+		}
+	);
+
+	return writer.flush() ? 0 : 1;
+}
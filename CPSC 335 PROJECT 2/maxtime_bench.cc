@@ -0,0 +1,1151 @@
+///////////////////////////////////////////////////////////////////////////////
+// maxtime_bench.cc
+//
+// Micro-benchmarks for maxtime.hh and its companion headers.
+//
+// Usage: bench [name ...]
+// With no arguments every benchmark runs; otherwise only the named ones.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <iterator>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "armor_approx.hh"
+#include "armor_bound.hh"
+#include "armor_catalogue.hh"
+#include "armor_columns.hh"
+#include "armor_dp.hh"
+#include "armor_exact.hh"
+#include "armor_generic.hh"
+#include "armor_selectivity.hh"
+#include "armor_solver.hh"
+#include "armor_writer.hh"
+#include "gzip_stream.hh"
+#include "maxtime.hh"
+#include "timer.hh"
+
+
+// Heap bytes allocated with new and not yet deleted, and the most ever at
+// once since the last reset, so benchmarks can report the memory a solver
+// needs. Every form of operator new and delete is replaced below, so none
+// goes to the library's allocator by accident: each block is malloc'd with
+// its size in a header of max(16, alignment) bytes, which the matching
+// delete reads back. The two helpers are kept out of line so the compiler
+// never pairs an inlined malloc with a free it cannot match.
+std::atomic<size_t> heap_bytes(0), heap_peak_bytes(0);
+
+__attribute__((noinline)) void* heap_allocate(size_t size, size_t alignment, bool nothrow)
+{
+	const size_t header = std::max<size_t>(16, alignment);
+	void* block = alignment > 16
+		? std::aligned_alloc(alignment, (size + header + alignment - 1) / alignment * alignment)
+		: std::malloc(size + header);
+	if ( ! block )
+	{
+		if (nothrow)
+		{
+			return nullptr;
+		}
+		throw std::bad_alloc();
+	}
+	*static_cast<size_t*>(block) = size;
+	size_t now = heap_bytes += size;
+	for (size_t peak = heap_peak_bytes; now > peak && ! heap_peak_bytes.compare_exchange_weak(peak, now); )
+	{
+	}
+	return static_cast<char*>(block) + header;
+}
+
+__attribute__((noinline)) void heap_release(void* pointer, size_t alignment)
+{
+	if (pointer)
+	{
+		void* block = static_cast<char*>(pointer) - std::max<size_t>(16, alignment);
+		heap_bytes -= *static_cast<size_t*>(block);
+		std::free(block);
+	}
+}
+
+void* operator new(size_t size) { return heap_allocate(size, 0, false); }
+void* operator new[](size_t size) { return heap_allocate(size, 0, false); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return heap_allocate(size, 0, true); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return heap_allocate(size, 0, true); }
+void* operator new(size_t size, std::align_val_t alignment) { return heap_allocate(size, size_t(alignment), false); }
+void* operator new[](size_t size, std::align_val_t alignment) { return heap_allocate(size, size_t(alignment), false); }
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return heap_allocate(size, size_t(alignment), true); }
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept { return heap_allocate(size, size_t(alignment), true); }
+
+void operator delete(void* pointer) noexcept { heap_release(pointer, 0); }
+void operator delete[](void* pointer) noexcept { heap_release(pointer, 0); }
+void operator delete(void* pointer, size_t) noexcept { heap_release(pointer, 0); }
+void operator delete[](void* pointer, size_t) noexcept { heap_release(pointer, 0); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { heap_release(pointer, 0); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { heap_release(pointer, 0); }
+void operator delete(void* pointer, std::align_val_t alignment) noexcept { heap_release(pointer, size_t(alignment)); }
+void operator delete[](void* pointer, std::align_val_t alignment) noexcept { heap_release(pointer, size_t(alignment)); }
+void operator delete(void* pointer, size_t, std::align_val_t alignment) noexcept { heap_release(pointer, size_t(alignment)); }
+void operator delete[](void* pointer, size_t, std::align_val_t alignment) noexcept { heap_release(pointer, size_t(alignment)); }
+void operator delete(void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept { heap_release(pointer, size_t(alignment)); }
+void operator delete[](void* pointer, std::align_val_t alignment, const std::nothrow_t&) noexcept { heap_release(pointer, size_t(alignment)); }
+
+// Start measuring the peak from the current heap size.
+void reset_heap_peak()
+{
+	heap_peak_bytes = heap_bytes.load();
+}
+
+
+// Cost of serialising one solution in each output format.
+void bench_writer(const ArmorVector& all_armors)
+{
+	const int solutions = 5000, items_per_solution = 8;
+
+	std::vector<ArmorVector> batch(solutions);
+	for (int i = 0; i < solutions; i++)
+	{
+		for (int j = 0; j < items_per_solution; j++)
+		{
+			batch[i].push_back(all_armors[(i * items_per_solution + j) % all_armors.size()]);
+		}
+	}
+
+	auto report = [&](const std::string& name, double seconds)
+	{
+		std::cout << "  " << name << ": " << seconds * 1e9 / solutions << " ns per solution" << std::endl;
+	};
+
+	std::cout << "writer: " << solutions << " solutions of " << items_per_solution << " items to /dev/null" << std::endl;
+
+	// The original print_armor_vector flushed after every line with std::endl.
+	{
+		std::ofstream null_stream("/dev/null");
+		Timer timer;
+		for (auto& armors : batch)
+		{
+			null_stream << "*** Armor Vector ***" << std::endl;
+			for (auto& armor : armors)
+			{
+				null_stream
+					<< "Ye olde " << armor->description()
+					<< " ==> "
+					<< "Cost of " << armor->cost() << " gold"
+					<< "; Defense points = " << armor->defense()
+					<< std::endl
+					;
+			}
+			double total_cost, total_defense;
+			sum_armor_vector(armors, total_cost, total_defense);
+			null_stream
+				<< "> Grand total cost: " << total_cost << " gold" << std::endl
+				<< "> Grand total defense: " << total_defense
+				<< std::endl
+				;
+		}
+		report("std::endl per line", timer.elapsed());
+	}
+
+	{
+		std::ofstream null_stream("/dev/null");
+		auto saved = std::cout.rdbuf(null_stream.rdbuf());
+		Timer timer;
+		for (auto& armors : batch)
+		{
+			print_armor_vector(armors);
+		}
+		double elapsed = timer.elapsed();
+		std::cout.rdbuf(saved);
+		report("print_armor_vector", elapsed);
+	}
+
+	std::vector<std::pair<std::string, ArmorFormat>> formats =
+	{
+		{ "text", ArmorFormat::text },
+		{ "jsonl", ArmorFormat::json_lines },
+		{ "binary", ArmorFormat::binary }
+	};
+	for (auto& format : formats)
+	{
+		int fd = ::open("/dev/null", O_WRONLY);
+		assert(fd >= 0);
+		size_t bytes;
+		Timer timer;
+		{
+			ArmorWriter writer(fd, format.second);
+			for (auto& armors : batch)
+			{
+				writer.write(armors);
+			}
+			writer.flush();
+			bytes = writer.bytes_written();
+		}
+		double elapsed = timer.elapsed();
+		::close(fd);
+		report("ArmorWriter " + format.first + " to fd (" + std::to_string(bytes / solutions) + " bytes each)", elapsed);
+	}
+}
+
+
+// Ingest time of a gzip-compressed catalogue, compared with decompressing
+// and parsing on their own.
+void bench_gzip()
+{
+	const int copies = 25;
+	const std::string
+		plain_path = "bench_catalogue.csv",
+		gzip_path = "bench_catalogue.csv.gz"
+		;
+
+	{
+		std::ifstream in("ride.csv", std::ios::binary);
+		std::string header, body;
+		std::getline(in, header);
+		body.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+		std::ofstream plain(plain_path, std::ios::binary);
+		gzFile compressed = gzopen(gzip_path.c_str(), "wb");
+		header += '\n';
+		plain << header;
+		gzwrite(compressed, header.data(), header.size());
+		for (int i = 0; i < copies; i++)
+		{
+			plain << body;
+			gzwrite(compressed, body.data(), body.size());
+		}
+		gzclose(compressed);
+	}
+
+	auto count_rows = [](const std::string& path)
+	{
+		size_t rows = 0;
+		scan_armor_database(path, 4096, [&](const ArmorVector& chunk) { rows += chunk.size(); return true; });
+		return rows;
+	};
+
+	Timer decompress_timer;
+	size_t inflated_bytes = 0;
+	{
+		GzipInputBuffer inflated(gzip_path);
+		std::vector<char> block(1 << 16);
+		for (std::streamsize n; (n = inflated.sgetn(block.data(), block.size())) > 0; )
+		{
+			inflated_bytes += n;
+		}
+	}
+	double decompress = decompress_timer.elapsed();
+
+	Timer parse_timer;
+	size_t plain_rows = count_rows(plain_path);
+	double parse = parse_timer.elapsed();
+
+	Timer ingest_timer;
+	size_t gzip_rows = count_rows(gzip_path);
+	double ingest = ingest_timer.elapsed();
+
+	std::remove(plain_path.c_str());
+	std::remove(gzip_path.c_str());
+
+	assert(plain_rows == gzip_rows);
+	std::cout
+		<< "gzip: " << gzip_rows << " rows, " << inflated_bytes << " bytes uncompressed" << std::endl
+		<< "  decompress only: " << decompress * 1000 << " ms" << std::endl
+		<< "  parse uncompressed file: " << parse * 1000 << " ms" << std::endl
+		<< "  overlapped gzip ingest: " << ingest * 1000 << " ms"
+		<< " (sum would be " << (decompress + parse) * 1000 << " ms)" << std::endl
+		;
+}
+
+
+// Double and float32 column kernels against the original ArmorVector solvers.
+void bench_columns(const ArmorVector& all_armors)
+{
+	auto filtered = filter_armor_vector(all_armors, 1.0, 2500.0, all_armors.size());
+	auto columns_d = make_armor_columns<double>(all_armors);
+	auto columns_f = make_armor_columns<float>(all_armors);
+
+	std::cout << "columns: times in ms, ArmorVector / double columns / float columns" << std::endl;
+
+	const int repeats = 20;
+	auto time = [&](const std::function<void()>& body)
+	{
+		Timer timer;
+		for (int r = 0; r < repeats; r++)
+		{
+			body();
+		}
+		return timer.elapsed() * 1000 / repeats;
+	};
+	std::cout
+		<< "  filter " << all_armors.size() << " rows: "
+		<< time([&]() { filter_armor_vector(all_armors, 100.0, 500.0, all_armors.size()); }) << " / "
+		<< time([&]() { filter_armor_columns(columns_d, all_armors, 100.0, 500.0, all_armors.size()); }) << " / "
+		<< time([&]() { filter_armor_columns(columns_f, all_armors, 100.0, 500.0, all_armors.size()); })
+		<< std::endl
+		;
+
+	auto greedy_input = filter_armor_vector(*filtered, 1.0, 2500.0, 4000);
+	auto greedy_d = make_armor_columns<double>(*greedy_input);
+	auto greedy_f = make_armor_columns<float>(*greedy_input);
+	std::cout
+		<< "  greedy n = " << greedy_input->size() << ": "
+		<< time([&]() { greedy_max_defense(*greedy_input, 2500.0); }) << " / "
+		<< time([&]() { greedy_max_defense_columns(greedy_d, *greedy_input, 2500.0); }) << " / "
+		<< time([&]() { greedy_max_defense_columns(greedy_f, *greedy_input, 2500.0); })
+		<< std::endl
+		;
+
+	for (int n = 16; n <= 24; n += 4)
+	{
+		auto items = filter_armor_vector(*filtered, 1.0, 2500.0, n);
+		auto items_d = make_armor_columns<double>(*items);
+		auto items_f = make_armor_columns<float>(*items);
+
+		Timer original_timer;
+		exhaustive_max_defense(*items, 2500.0);
+		double original = original_timer.elapsed() * 1000;
+
+		Timer double_timer;
+		exhaustive_max_defense_columns(items_d, *items, 2500.0);
+		double with_double = double_timer.elapsed() * 1000;
+
+		Timer float_timer;
+		exhaustive_max_defense_columns(items_f, *items, 2500.0);
+		double with_float = float_timer.elapsed() * 1000;
+
+		std::cout << "  exhaustive n = " << n << ": " << original << " / " << with_double << " / " << with_float << std::endl;
+	}
+}
+
+
+// Filter throughput over a large catalogue with double, float32 and 16-bit
+// quantised columns. Rows are repeated pointers to the real catalogue, so
+// only the columns take real memory.
+void bench_quantized(const ArmorVector& all_armors)
+{
+	const size_t rows = 4000000;
+	ArmorVector large;
+	large.reserve(rows);
+	for (size_t i = 0; i < rows; i++)
+	{
+		large.push_back(all_armors[i % all_armors.size()]);
+	}
+
+	auto columns_d = make_armor_columns<double>(large);
+	auto columns_f = make_armor_columns<float>(large);
+	auto quantized = make_armor_quantized_columns(large);
+
+	std::cout << "quantized: filter " << rows << " rows, defense 100 to 110, in rows per second" << std::endl;
+
+	auto report = [&](const std::string& name, const std::function<size_t()>& filter)
+	{
+		Timer timer;
+		size_t matches = filter();
+		double elapsed = timer.elapsed();
+		std::cout << "  " << name << ": " << rows / elapsed << " (" << matches << " matches)" << std::endl;
+	};
+	report("ArmorVector", [&]() { return filter_armor_vector(large, 100.0, 110.0, rows)->size(); });
+	report("double columns", [&]() { return filter_armor_columns(columns_d, large, 100.0, 110.0, rows)->size(); });
+	report("float columns", [&]() { return filter_armor_columns(columns_f, large, 100.0, 110.0, rows)->size(); });
+	report("16-bit quantised", [&]() { return filter_armor_quantized(quantized, large, 100.0, 110.0, rows)->size(); });
+}
+
+
+// Conflict-aware exact search on random conflict graphs of several densities:
+// enumerating every subset and post-filtering, against enumeration that skips
+// conflicting mask ranges, against branch and bound.
+void bench_conflicts(const ArmorVector& all_armors)
+{
+	auto filtered = filter_armor_vector(all_armors, 1.0, 2500.0, all_armors.size());
+	const double budget = 5000.0;
+
+	std::cout << "conflicts: times in ms, post-filter / range-skipping exhaustive / branch and bound" << std::endl;
+
+	for (int n : { 20, 24 })
+	{
+		auto items = filter_armor_vector(*filtered, 1.0, 2500.0, n);
+
+		for (double density : { 0.0, 0.05, 0.5 })
+		{
+			std::mt19937 random(335);
+			std::bernoulli_distribution edge(density);
+			ArmorConflicts conflicts(n, 0);
+			for (int i = 0; i < n; i++)
+			{
+				for (int j = i + 1; j < n; j++)
+				{
+					if (edge(random))
+					{
+						add_armor_conflict(conflicts, i, j);
+					}
+				}
+			}
+
+			// What callers did before: enumerate everything, then reject.
+			Timer post_filter_timer;
+			double post_filter_best = 0;
+			for (uint64_t mask = 0; mask < (uint64_t(1) << n); mask++)
+			{
+				double cost = 0, defense = 0;
+				for (uint64_t rest = mask; rest; rest &= rest - 1)
+				{
+					int bit = __builtin_ctzll(rest);
+					cost += (*items)[bit]->cost();
+					defense += (*items)[bit]->defense();
+				}
+				if (cost <= budget && defense > post_filter_best && armor_subset_compatible(conflicts, mask))
+				{
+					post_filter_best = defense;
+				}
+			}
+			double post_filter = post_filter_timer.elapsed() * 1000;
+
+			Timer exhaustive_timer;
+			auto exhaustive = exhaustive_max_defense_conflicts(*items, budget, conflicts);
+			double with_exhaustive = exhaustive_timer.elapsed() * 1000;
+
+			Timer bnb_timer;
+			auto bnb = branch_and_bound_max_defense(*items, budget, conflicts);
+			double with_bnb = bnb_timer.elapsed() * 1000;
+
+			double cost, exhaustive_defense, bnb_defense;
+			sum_armor_vector(*exhaustive, cost, exhaustive_defense);
+			sum_armor_vector(*bnb, cost, bnb_defense);
+			assert(std::fabs(exhaustive_defense - post_filter_best) < 1e-6);
+			assert(std::fabs(bnb_defense - post_filter_best) < 1e-6);
+
+			std::cout
+				<< "  n = " << n << ", density " << density << ": "
+				<< post_filter << " / " << with_exhaustive << " / " << with_bnb
+				<< std::endl
+				;
+		}
+	}
+}
+
+
+// Upgrade dependencies: enumerating every subset and rejecting those with an
+// upgrade but not its base item, against tree-knapsack DP. Enumeration
+// doubles with each item while the DP grows linearly in n, O(n * width).
+void bench_dependencies(const ArmorVector& all_armors)
+{
+	auto filtered = filter_armor_vector(all_armors, 1.0, 2500.0, all_armors.size());
+	const double budget = 2500.0;
+
+	std::cout << "dependencies: times in ms, filtered exhaustive / tree-knapsack DP at scale "
+		<< armor_cost_scale(all_armors) << std::endl;
+
+	for (int n : { 16, 20, 24 })
+	{
+		auto items = filter_armor_vector(*filtered, 1.0, 2500.0, n);
+
+		// Two thirds of the items upgrade a random earlier item.
+		std::mt19937 random(335);
+		ArmorDependencies dependencies(n, -1);
+		for (int i = 1; i < n; i++)
+		{
+			if (random() % 3)
+			{
+				dependencies[i] = random() % i;
+			}
+		}
+
+		Timer exhaustive_timer;
+		double exhaustive_best = 0;
+		for (uint64_t mask = 0; mask < (uint64_t(1) << n); mask++)
+		{
+			double cost = 0, defense = 0;
+			for (uint64_t rest = mask; rest; rest &= rest - 1)
+			{
+				int bit = __builtin_ctzll(rest);
+				cost += (*items)[bit]->cost();
+				defense += (*items)[bit]->defense();
+			}
+			if (cost <= budget && defense > exhaustive_best && armor_subset_closed(dependencies, mask))
+			{
+				exhaustive_best = defense;
+			}
+		}
+		double exhaustive = exhaustive_timer.elapsed() * 1000;
+
+		Timer dp_timer;
+		auto solution = tree_knapsack_max_defense(*items, budget, dependencies);
+		double dp = dp_timer.elapsed() * 1000;
+
+		double cost, defense;
+		sum_armor_vector(*solution, cost, defense);
+		assert(std::fabs(defense - exhaustive_best) < 1e-6);
+
+		std::cout << "  n = " << n << ": " << exhaustive << " / " << dp << std::endl;
+	}
+}
+
+
+// Loadouts capped at k items: enumerating every subset and rejecting the
+// large ones, against enumerating only the subsets of at most k items.
+void bench_cardinality(const ArmorVector& all_armors)
+{
+	auto filtered = filter_armor_vector(all_armors, 1.0, 2500.0, all_armors.size());
+	const double budget = 2500.0;
+
+	std::cout << "cardinality: times in ms, all 2^n subsets / at most k (subsets visited)" << std::endl;
+
+	for (int n : { 20, 24, 40, 63 })
+	{
+		auto items = filter_armor_vector(*filtered, 1.0, 2500.0, n);
+
+		for (int k : { 2, 4 })
+		{
+			std::stringstream all_subsets;
+			double all_best = -1;
+			if (n <= 24)
+			{
+				Timer all_timer;
+				all_best = 0;
+				for (uint64_t mask = 0; mask < (uint64_t(1) << n); mask++)
+				{
+					if (__builtin_popcountll(mask) > k)
+					{
+						continue;
+					}
+					double cost = 0, defense = 0;
+					for (uint64_t rest = mask; rest; rest &= rest - 1)
+					{
+						int bit = __builtin_ctzll(rest);
+						cost += (*items)[bit]->cost();
+						defense += (*items)[bit]->defense();
+					}
+					if (cost <= budget && defense > all_best)
+					{
+						all_best = defense;
+					}
+				}
+				all_subsets << all_timer.elapsed() * 1000;
+			}
+			else
+			{
+				all_subsets << "-";
+			}
+
+			Timer at_most_timer;
+			auto solution = exhaustive_max_defense_at_most(*items, budget, k);
+			double at_most = at_most_timer.elapsed() * 1000;
+
+			double cost, defense;
+			sum_armor_vector(*solution, cost, defense);
+			assert(all_best < 0 || std::fabs(defense - all_best) < 1e-6);
+
+			std::cout
+				<< "  n = " << n << ", k = " << k << ": "
+				<< all_subsets.str() << " / " << at_most << " (" << armor_subsets_at_most(n, k) << ")"
+				<< std::endl
+				;
+		}
+	}
+}
+
+
+// Exact search over maximal feasible subsets only, against the fastest
+// full enumeration, exhaustive_max_defense_columns.
+void bench_maximal(const ArmorVector& all_armors)
+{
+	auto filtered = filter_armor_vector(all_armors, 1.0, 2500.0, all_armors.size());
+
+	std::cout << "maximal: times in ms, all 2^n subsets / maximal subsets (subsets evaluated of 2^n)" << std::endl;
+
+	for (int n : { 16, 20, 24, 28 })
+	{
+		auto items = filter_armor_vector(*filtered, 1.0, 2500.0, n);
+		auto columns = make_armor_columns<double>(*items);
+
+		for (double budget : { 1000.0, 5000.0 })
+		{
+			std::stringstream all_subsets;
+			double all_defense = -1;
+			if (n <= 24)
+			{
+				Timer all_timer;
+				auto solution = exhaustive_max_defense_columns(columns, *items, budget);
+				all_subsets << all_timer.elapsed() * 1000;
+				double cost;
+				sum_armor_vector(*solution, cost, all_defense);
+			}
+			else
+			{
+				all_subsets << "-";
+			}
+
+			uint64_t evaluated = 0;
+			Timer maximal_timer;
+			auto solution = maximal_max_defense(*items, budget, &evaluated);
+			double maximal = maximal_timer.elapsed() * 1000;
+
+			double cost, defense;
+			sum_armor_vector(*solution, cost, defense);
+			assert(all_defense < 0 || std::fabs(defense - all_defense) < 1e-6);
+
+			std::cout
+				<< "  n = " << n << ", budget " << budget << ": "
+				<< all_subsets.str() << " / " << maximal
+				<< " (" << evaluated << " of " << double(uint64_t(1) << n) << ")"
+				<< std::endl
+				;
+		}
+	}
+}
+
+
+// The O(n) Dantzig bound against computing it with a full sort, and against
+// the greedy solve it checks.
+void bench_bound(const ArmorVector& all_armors)
+{
+	std::cout << "bound: times in ms, sorted bound / Balas-Zemel bound / greedy_max_defense" << std::endl;
+
+	for (size_t rows : { size_t(8064), size_t(100000), size_t(1000000) })
+	{
+		ArmorVector large;
+		large.reserve(rows);
+		for (size_t i = 0; i < rows; i++)
+		{
+			large.push_back(all_armors[i % all_armors.size()]);
+		}
+		const double budget = 2500.0 * rows / all_armors.size();
+
+		Timer sorted_timer;
+		std::vector<std::pair<double, std::pair<double, double>>> sorted;
+		sorted.reserve(rows);
+		for (auto& armor : large)
+		{
+			sorted.push_back({ -armor->defense() / armor->cost(), { armor->cost(), armor->defense() } });
+		}
+		std::sort(sorted.begin(), sorted.end());
+		double room = budget, sorted_bound = 0;
+		for (auto& entry : sorted)
+		{
+			if (entry.second.first > room)
+			{
+				sorted_bound += entry.second.second * room / entry.second.first;
+				break;
+			}
+			room -= entry.second.first;
+			sorted_bound += entry.second.second;
+		}
+		double with_sort = sorted_timer.elapsed() * 1000;
+
+		Timer selection_timer;
+		double bound = dantzig_upper_bound(large, budget);
+		double with_selection = selection_timer.elapsed() * 1000;
+		assert(std::fabs(bound - sorted_bound) <= 1e-9 * bound);
+
+		std::stringstream greedy;
+		if (rows <= 8064)
+		{
+			Timer greedy_timer;
+			greedy_max_defense(large, budget);
+			greedy << greedy_timer.elapsed() * 1000;
+		}
+		else
+		{
+			greedy << "-";
+		}
+
+		std::cout << "  n = " << rows << ": " << with_sort << " / " << with_selection << " / " << greedy.str() << std::endl;
+	}
+}
+
+
+// Solution quality against time and memory for every registered solver,
+// over a grid of catalogue sizes and budgets, skipping sizes beyond a
+// solver's fast_n. Approximate solvers run at several epsilons. Defense is
+// reported as a fraction of the optimum found by tree_knapsack_max_defense.
+// Prints a table, and writes the same rows tab-separated to
+// bench_quality.dat for plotting.
+void bench_quality(const ArmorVector& all_armors)
+{
+	auto filtered = filter_armor_vector(all_armors, 1.0, 2500.0, all_armors.size());
+
+	std::ofstream data("bench_quality.dat");
+	data << "algorithm\tepsilon\tn\tbudget\tms\tbytes\tfraction" << '\n';
+
+	std::cout
+		<< "quality: defense as a fraction of optimal, time in ms, peak heap in KiB; rows also in bench_quality.dat" << std::endl
+		<< "  " << std::left << std::setw(18) << "algorithm" << std::setw(8) << "epsilon" << std::right
+		<< std::setw(6) << "n" << std::setw(8) << "budget"
+		<< std::setw(12) << "ms" << std::setw(12) << "KiB" << std::setw(12) << "fraction" << std::endl
+		;
+
+	for (int n : { 20, 100, 500 })
+	{
+		auto items = filter_armor_vector(*filtered, 1.0, 2500.0, n);
+		for (double budget : { 500.0, 2500.0 })
+		{
+			double optimum_cost, optimum;
+			sum_armor_vector(*tree_knapsack_max_defense(*items, budget), optimum_cost, optimum);
+
+			for (auto& solver : armor_solvers())
+			{
+				if (size_t(n) > solver.capabilities().fast_n)
+				{
+					continue;
+				}
+
+				std::vector<double> epsilons = { 0.0 };
+				if (solver.capabilities().approximate)
+				{
+					epsilons = { 0.5, 0.1, 0.02 };
+				}
+				for (double epsilon : epsilons)
+				{
+					ArmorSolveContext context;
+					context.epsilon = epsilon;
+
+					reset_heap_peak();
+					size_t heap_before = heap_bytes;
+					Timer timer;
+					auto solution = solver.solve(*items, budget, context);
+					double ms = timer.elapsed() * 1000;
+					size_t bytes = heap_peak_bytes - heap_before;
+
+					double cost, defense;
+					sum_armor_vector(*solution, cost, defense);
+					assert(cost <= budget);
+					double fraction = optimum > 0 ? defense / optimum : 1;
+
+					std::cout
+						<< "  " << std::left << std::setw(18) << solver.name() << std::setw(8) << epsilon << std::right
+						<< std::setw(6) << n << std::setw(8) << budget
+						<< std::setw(12) << ms << std::setw(12) << bytes / 1024.0 << std::setw(12) << fraction
+						<< std::endl
+						;
+					data
+						<< solver.name() << '\t' << epsilon << '\t' << n << '\t' << budget << '\t'
+						<< ms << '\t' << bytes << '\t' << fraction << '\n'
+						;
+				}
+			}
+		}
+	}
+}
+
+
+// Predicted against measured peak heap for the solvers with a footprint
+// model, and the path each takes under a memory limit of a quarter of its
+// prediction.
+void bench_memory(const ArmorVector& all_armors)
+{
+	auto filtered = filter_armor_vector(all_armors, 1.0, 2500.0, all_armors.size());
+
+	std::cout << "memory: predicted / measured peak heap in KiB, then time in ms and path at a quarter of predicted" << std::endl;
+
+	for (int n : { 50, 200 })
+	{
+		auto items = filter_armor_vector(*filtered, 1.0, 2500.0, n);
+		for (auto& solver : armor_solvers())
+		{
+			ArmorSolveContext probe;
+			if (solver.footprint(*items, 2500.0, probe) == 0 || size_t(n) > solver.capabilities().fast_n)
+			{
+				continue;
+			}
+
+			ArmorSolveContext context;
+			reset_heap_peak();
+			size_t heap_before = heap_bytes;
+			solver.solve(*items, 2500.0, context);
+			size_t measured = heap_peak_bytes - heap_before;
+
+			ArmorSolveContext capped;
+			capped.memory_limit = context.predicted_bytes / 4;
+			Timer timer;
+			solver.solve(*items, 2500.0, capped);
+			double ms = timer.elapsed() * 1000;
+
+			std::cout
+				<< "  " << solver.name() << " n = " << n << ": "
+				<< context.predicted_bytes / 1024.0 << " / " << measured / 1024.0
+				<< ", " << ms << " via " << capped.path
+				<< std::endl
+				;
+		}
+	}
+}
+
+
+// Filter then greedy as maxtime_main does it, against a filtered view of a
+// catalogue whose ratio order was computed once at load.
+void bench_ratio(const ArmorVector& all_armors)
+{
+	Timer catalogue_timer;
+	ArmorCatalogue catalogue(std::make_shared<const ArmorVector>(all_armors));
+	double ordering = catalogue_timer.elapsed() * 1000;
+
+	std::cout << "ratio: times in ms, filter + greedy_max_defense / view + linear greedy; ordering the catalogue took "
+		<< ordering << std::endl;
+
+	for (int total_size : { 200, 1000, 4000 })
+	{
+		Timer original_timer;
+		auto filtered = filter_armor_vector(all_armors, 1.0, 2500.0, total_size);
+		auto expected = greedy_max_defense(*filtered, 2500.0);
+		double original = original_timer.elapsed() * 1000;
+
+		Timer view_timer;
+		auto view = filter_armor_catalogue(catalogue, 1.0, 2500.0, total_size);
+		auto actual = greedy_max_defense_view(catalogue, view, 2500.0);
+		double with_view = view_timer.elapsed() * 1000;
+		assert(expected->size() == actual->size());
+
+		std::cout << "  total_size = " << total_size << ": " << original << " / " << with_view << std::endl;
+	}
+}
+
+
+// Milliseconds per run of a generic engine on access, averaged over repeats.
+template <typename Value, typename Access>
+double time_armor_generic(const std::string& engine, const Access& access, double budget, int repeats)
+{
+	const int64_t scale = armor_cost_scale(access);
+	size_t chosen = 0;
+	Timer timer;
+	for (int r = 0; r < repeats; r++)
+	{
+		if (engine == "greedy")
+		{
+			chosen += greedy_max_defense_generic<Value>(access, budget).size();
+		}
+		else if (engine == "exhaustive")
+		{
+			chosen += exhaustive_max_defense_generic<Value>(access, budget).size();
+		}
+		else
+		{
+			chosen += knapsack_max_defense_generic<Value>(access, budget, scale).size();
+		}
+	}
+	double ms = timer.elapsed() * 1000 / repeats;
+	assert(chosen > 0);
+	return ms;
+}
+
+
+// One line of bench_generic: an access policy under each value type.
+template <typename Access>
+void bench_generic_access(const std::string& name, const std::string& engine, const Access& access, int repeats)
+{
+	std::cout
+		<< "    " << name << ": "
+		<< time_armor_generic<double>(engine, access, 2500.0, repeats) << " / "
+		<< time_armor_generic<float>(engine, access, 2500.0, repeats) << " / "
+		<< time_armor_generic<int64_t>(engine, access, 2500.0, repeats)
+		<< std::endl
+		;
+}
+
+
+// The generic engines for every value type and access policy, after the
+// ArmorVector solver that runs each one in double.
+void bench_generic(const ArmorVector& all_armors)
+{
+	ArmorCatalogue catalogue(std::make_shared<const ArmorVector>(all_armors));
+
+	std::cout << "generic: times in ms, ArmorVector solver, then double / float / int64 fixed point per access policy" << std::endl;
+
+	struct Engine { std::string name; int n, repeats; std::function<void(const ArmorVector&)> original; };
+	std::vector<Engine> engines =
+	{
+		{ "greedy", 4000, 10, [](const ArmorVector& items) { greedy_max_defense(items, 2500.0); } },
+		{ "exhaustive", 18, 3, [](const ArmorVector& items) { exhaustive_max_defense(items, 2500.0); } },
+		{ "knapsack", 50, 3, [](const ArmorVector& items) { tree_knapsack_max_defense(items, 2500.0); } }
+	};
+
+	for (auto& engine : engines)
+	{
+		auto items = filter_armor_vector(all_armors, 1.0, 2500.0, engine.n);
+		auto view = filter_armor_catalogue(catalogue, 1.0, 2500.0, engine.n);
+		auto columns = make_armor_columns<double>(*items);
+
+		const std::string snapshot_path = "bench_generic.snapshot";
+		ArmorSnapshotMap snapshot;
+		bool mapped = save_armor_snapshot(*items, snapshot_path) && snapshot.open(snapshot_path);
+		std::remove(snapshot_path.c_str());
+		assert(mapped);
+		(void) mapped;
+
+		Timer original_timer;
+		for (int r = 0; r < engine.repeats; r++)
+		{
+			engine.original(*items);
+		}
+		std::cout << "  " << engine.name << " n = " << items->size() << ": " << original_timer.elapsed() * 1000 / engine.repeats << std::endl;
+
+		bench_generic_access("vector", engine.name, ArmorVectorAccess{ *items }, engine.repeats);
+		bench_generic_access("columns", engine.name, ArmorColumnsAccess<double>{ columns }, engine.repeats);
+		bench_generic_access("view", engine.name, ArmorViewAccess{ catalogue, view }, engine.repeats);
+		bench_generic_access("snapshot", engine.name, snapshot, engine.repeats);
+	}
+}
+
+
+// Count-only answers to a defense filter, against materialising it; and
+// estimates for predicates on several columns against a full scan.
+void bench_selectivity(const ArmorVector& all_armors)
+{
+	Timer build_timer;
+	ArmorDefenseIndex index(all_armors);
+	double index_build = build_timer.elapsed() * 1000;
+	build_timer.reset();
+	ArmorSelectivity selectivity(all_armors);
+	double selectivity_build = build_timer.elapsed() * 1000;
+
+	std::cout << "selectivity: times in us, filter_armor_vector size / defense index / histogram; building took "
+		<< index_build << " / " << selectivity_build << " ms" << std::endl;
+
+	auto time = [&](const std::function<double()>& body, int repeats = 1000)
+	{
+		double total = 0;
+		Timer timer;
+		for (int r = 0; r < repeats; r++)
+		{
+			total += body();
+		}
+		double us = timer.elapsed() * 1e6 / repeats;
+		assert(total >= 0);
+		return us;
+	};
+
+	for (auto range : { std::make_pair(100.0, 500.0), std::make_pair(1.0, 2500.0) })
+	{
+		size_t expected = filter_armor_vector(all_armors, range.first, range.second, all_armors.size())->size();
+		std::cout
+			<< "  [" << range.first << ", " << range.second << "], " << expected << " items: "
+			<< time([&]() { return double(filter_armor_vector(all_armors, range.first, range.second, all_armors.size())->size()); }, 20) << " / "
+			<< time([&]() { return double(index.count(range.first, range.second)); }) << " / "
+			<< time([&]() { return selectivity.defense().count(range.first, range.second); })
+			<< std::endl
+			;
+	}
+
+	ArmorPredicate predicate;
+	predicate.min_cost = 300;
+	predicate.max_cost = 600;
+	predicate.min_ratio = 1;
+	size_t exact = count_armor_predicate(all_armors, predicate);
+	std::cout
+		<< "  cost in [300, 600] and ratio >= 1, " << exact << " items, estimated " << selectivity.estimate(predicate)
+		<< " (at most " << selectivity.upper_estimate(predicate) << "): scan / estimate "
+		<< time([&]() { return double(count_armor_predicate(all_armors, predicate)); }, 100) << " / "
+		<< time([&]() { return selectivity.estimate(predicate); })
+		<< std::endl
+		;
+}
+
+
+// Instances that are hard for bound-based exact search, in the classes
+// of the knapsack literature, of n items each with costs in cents from 100
+// to 1000 gold and a budget of half the total cost: uncorrelated, weakly
+// correlated (defense within 10% of cost), strongly correlated (defense
+// cost + 100) and subset-sum (defense equals cost); plus the first n
+// ride.csv items at the same budget ratio.
+std::vector<std::pair<std::string, ArmorVector>> hard_armor_instances(const ArmorVector& all_armors, size_t n, unsigned seed = 335)
+{
+	std::mt19937 random(seed);
+	std::uniform_int_distribution<int> cents(10000, 100000);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+	std::vector<std::pair<std::string, std::function<double(double)>>> classes =
+	{
+		{ "uncorrelated", [&](double) { return std::round(100 + 900 * unit(random)); } },
+		{ "weakly correlated", [&](double cost) { return std::round(cost * (0.9 + 0.2 * unit(random))); } },
+		{ "strongly correlated", [](double cost) { return cost + 100; } },
+		{ "subset-sum", [](double cost) { return cost; } }
+	};
+
+	std::vector<std::pair<std::string, ArmorVector>> instances;
+	for (auto& kind : classes)
+	{
+		ArmorVector items;
+		for (size_t i = 0; i < n; i++)
+		{
+			double cost = cents(random) / 100.0;
+			items.push_back(std::make_shared<ArmorItem>(kind.first + " " + std::to_string(i), cost, kind.second(cost)));
+		}
+		instances.emplace_back(kind.first, items);
+	}
+	auto ride = filter_armor_vector(all_armors, 1.0, 2500.0, n);
+	instances.emplace_back("ride.csv", *ride);
+	return instances;
+}
+
+
+// Half the total cost of items, the budget hard_armor_instances are solved at.
+double hard_armor_budget(const ArmorVector& items)
+{
+	double cost, defense;
+	sum_armor_vector(items, cost, defense);
+	return std::floor(cost / 2);
+}
+
+
+// Profiled branch and bound on the hard instances: how much profiling
+// costs, where the nodes are and how fast the incumbent settles. The full
+// report is printed for the hardest instance, and its collapsed stacks are
+// written to bench_search.folded for flamegraph.pl.
+void bench_search(const ArmorVector& all_armors)
+{
+	std::cout << "search: time in ms without / with profile, nodes, incumbents, node of the last incumbent" << std::endl;
+
+	ArmorSearchProfile hardest;
+	std::string hardest_name;
+	for (auto& instance : hard_armor_instances(all_armors, 40))
+	{
+		const ArmorVector& items = instance.second;
+		const double budget = hard_armor_budget(items);
+
+		Timer plain_timer;
+		auto expected = branch_and_bound_max_defense(items, budget);
+		double plain = plain_timer.elapsed() * 1000;
+
+		ArmorSearchProfile profile;
+		Timer profiled_timer;
+		auto actual = branch_and_bound_max_defense(items, budget, ArmorConflicts(), &profile);
+		double profiled = profiled_timer.elapsed() * 1000;
+		assert(expected->size() == actual->size());
+
+		std::cout
+			<< "  " << instance.first << ": " << plain << " / " << profiled << ", " << profile.nodes()
+			<< ", " << profile.incumbents.size() << ", " << profile.incumbents.back().nodes
+			<< std::endl
+			;
+		if (profile.nodes() > hardest.nodes())
+		{
+			hardest = profile;
+			hardest_name = instance.first;
+		}
+	}
+
+	std::cout << "  " << hardest_name << ":" << std::endl;
+	std::stringstream report;
+	write_armor_search_report(hardest, report);
+	for (std::string line; std::getline(report, line); )
+	{
+		std::cout << "    " << line << std::endl;
+	}
+
+	std::ofstream folded("bench_search.folded");
+	write_armor_search_flamegraph(hardest, folded);
+}
+
+
+// Best-first against depth-first branch and bound on the hard instances,
+// with an unlimited queue and with one capped at 16 KiB.
+void bench_best_first(const ArmorVector& all_armors)
+{
+	std::cout << "best_first: time in ms (nodes), depth first / best first / best first in 16 KiB, then peak queue KiB" << std::endl;
+
+	for (size_t n : { size_t(40), size_t(200) })
+	{
+		for (auto& instance : hard_armor_instances(all_armors, n))
+		{
+			const ArmorVector& items = instance.second;
+			const double budget = hard_armor_budget(items);
+			// Beyond 40 items these take depth first search far too long.
+			if (n > 40 && (instance.first == "subset-sum" || instance.first == "strongly correlated"))
+			{
+				continue;
+			}
+
+			Timer depth_first_timer;
+			auto expected = branch_and_bound_max_defense(items, budget);
+			double depth_first = depth_first_timer.elapsed() * 1000;
+
+			// Profiled separately, for the node count only.
+			ArmorSearchProfile profile;
+			branch_and_bound_max_defense(items, budget, ArmorConflicts(), &profile);
+
+			ArmorBestFirstStats unlimited, capped;
+			Timer best_first_timer;
+			auto actual = best_first_max_defense(items, budget, SIZE_MAX, &unlimited);
+			double best_first = best_first_timer.elapsed() * 1000;
+
+			Timer capped_timer;
+			auto capped_actual = best_first_max_defense(items, budget, 16 * 1024, &capped);
+			double with_cap = capped_timer.elapsed() * 1000;
+
+			double expected_cost, expected_defense, cost, defense;
+			sum_armor_vector(*expected, expected_cost, expected_defense);
+			sum_armor_vector(*actual, cost, defense);
+			assert(std::fabs(defense - expected_defense) < 1e-6);
+			sum_armor_vector(*capped_actual, cost, defense);
+			assert(std::fabs(defense - expected_defense) < 1e-6);
+
+			std::cout
+				<< "  " << instance.first << " n = " << n << ": "
+				<< depth_first << " (" << profile.nodes() << ") / "
+				<< best_first << " (" << unlimited.nodes << ") / "
+				<< with_cap << " (" << capped.nodes + capped.depth_first_nodes << "), "
+				<< unlimited.peak_bytes / 1024.0 << " / " << capped.peak_bytes / 1024.0
+				<< std::endl
+				;
+		}
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	auto all_armors = load_armor_database("ride.csv");
+	assert( all_armors );
+
+	std::vector<std::pair<std::string, std::function<void()>>> benchmarks =
+	{
+		{ "writer", [&]() { bench_writer(*all_armors); } },
+		{ "gzip", [&]() { bench_gzip(); } },
+		{ "columns", [&]() { bench_columns(*all_armors); } },
+		{ "quantized", [&]() { bench_quantized(*all_armors); } },
+		{ "conflicts", [&]() { bench_conflicts(*all_armors); } },
+		{ "dependencies", [&]() { bench_dependencies(*all_armors); } },
+		{ "cardinality", [&]() { bench_cardinality(*all_armors); } },
+		{ "maximal", [&]() { bench_maximal(*all_armors); } },
+		{ "bound", [&]() { bench_bound(*all_armors); } },
+		{ "quality", [&]() { bench_quality(*all_armors); } },
+		{ "memory", [&]() { bench_memory(*all_armors); } },
+		{ "ratio", [&]() { bench_ratio(*all_armors); } },
+		{ "generic", [&]() { bench_generic(*all_armors); } },
+		{ "selectivity", [&]() { bench_selectivity(*all_armors); } },
+		{ "search", [&]() { bench_search(*all_armors); } },
+		{ "best_first", [&]() { bench_best_first(*all_armors); } }
+	};
+
+	for (auto& benchmark : benchmarks)
+	{
+		bool selected = argc == 1;
+		for (int i = 1; i < argc; i++)
+		{
+			selected = selected || benchmark.first == argv[i];
+		}
+		if (selected)
+		{
+			benchmark.second();
+			std::cout << std::endl;
+		}
+	}
+
+	return 0;
+}
@@ -1,3 +1,5 @@
+#include "armor_bound.hh"
+#include "armor_catalogue.hh"
 #include "maxtime.hh"
 #include "timer.hh"
 #include <cassert>
@@ -12,14 +14,19 @@
 
 int main()
 {
-    auto all_armors = load_armor_database("ride.csv");
+    int MAX = 20;
+
+    // Only the first 200 * MAX matching rows are ever used, so stop reading
+    // ride.csv as soon as they have been found.
+    auto all_armors = filter_armor_database("ride.csv", 1.0, 2500.0, 200 * MAX);
 	assert( all_armors );
 
-    int MAX = 20;
     double time_greedy[MAX + 1];
     double time_exhaustive[MAX + 1];
+    double gap_greedy[MAX + 1];
     time_exhaustive[0] = 0.0;
     time_greedy[0] = 0.0;
+    gap_greedy[0] = 0.0;
 
 
     for(int i = 1; i <= MAX; i++)
@@ -47,12 +54,40 @@ int main()
             average_time_taken_greedy += time_taken_greedy;
         }
         time_greedy[i] = average_time_taken_greedy / 10;
+
+        // How far greedy may be from optimal, checked in O(n) outside the timing.
+        auto greedy_input = filter_armor_vector(*all_armors, 1.0, 2500.0, 200 * i);
+        gap_greedy[i] = armor_solution_gap(*greedy_input, 2500.0, *soln_greedy).relative() * 100;
     }
+    // The same greedy sweep, appending 200 items per step to one
+    // ArmorPrefixGreedy instead of solving each prefix from scratch.
+    double time_incremental[MAX + 1];
+    time_incremental[0] = 0.0;
+    for(int i = 1; i <= MAX; i++) time_incremental[i] = 0.0;
+    for(int j = 0; j < 10; j++)
+    {
+        ArmorPrefixGreedy sweep;
+        for(int i = 1; i <= MAX; i++)
+        {
+            Timer t;
+            ArmorVector appended(all_armors->begin() + 200 * (i - 1), all_armors->begin() + std::min<size_t>(200 * i, all_armors->size()));
+            sweep.append(appended);
+            sweep.solve(2500.0);
+            time_incremental[i] += t.elapsed() * 1000 / 10;
+        }
+    }
+
     std::cout<<"\nAverage time taken for exhaustive in milliseconds\n"<<std::endl;
     for(int i = 0; i < MAX + 1; i++) std::cout<<" " <<time_exhaustive[i]<<std::endl;
 
     std::cout<<"\nAverage time taken for greedy in milliseconds\n"<<std::endl;
     for(int i = 0; i < MAX + 1; i++) std::cout<<" " <<time_greedy[i]<<std::endl;
+
+    std::cout<<"\nAverage time taken for each incremental greedy step in milliseconds\n"<<std::endl;
+    for(int i = 0; i < MAX + 1; i++) std::cout<<" " <<time_incremental[i]<<std::endl;
+
+    std::cout<<"\nGreedy optimality gap against the Dantzig bound in percent\n"<<std::endl;
+    for(int i = 0; i < MAX + 1; i++) std::cout<<" " <<gap_greedy[i]<<std::endl;
 	return 0;
 }
 
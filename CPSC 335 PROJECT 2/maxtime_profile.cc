@@ -0,0 +1,45 @@
+///////////////////////////////////////////////////////////////////////////////
+// maxtime_profile.cc
+//
+// Print a JSON profile of an armor catalogue; see armor_profile.hh.
+//
+// Usage: profile [CATALOGUE [MIN_DEFENSE MAX_DEFENSE]]
+//	CATALOGUE defaults to ride.csv, and may be any database load_armor_database accepts.
+//	With MIN_DEFENSE and MAX_DEFENSE, only the items filter_armor_vector
+//	would keep are profiled.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "armor_profile.hh"
+#include "maxtime.hh"
+
+
+int main(int argc, char* argv[])
+{
+	if (argc != 1 && argc != 2 && argc != 4)
+	{
+		std::cerr << "Usage: " << argv[0] << " [CATALOGUE [MIN_DEFENSE MAX_DEFENSE]]" << std::endl;
+		return 2;
+	}
+
+	std::string catalogue_path = argc > 1 ? argv[1] : "ride.csv";
+
+	auto armors = load_armor_database(catalogue_path);
+	if ( ! armors )
+	{
+		return 1;
+	}
+
+	if (argc == 4)
+	{
+		armors = filter_armor_vector(*armors, std::atof(argv[2]), std::atof(argv[3]), armors->size());
+	}
+
+	write_armor_profile_json(profile_armor_vector(*armors), std::cout);
+	return 0;
+}
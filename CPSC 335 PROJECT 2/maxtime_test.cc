@@ -7,13 +7,55 @@
 
 
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
 #include <sstream>
+#include <thread>
 
 
+#include "armor_approx.hh"
+#include "armor_batch.hh"
+#include "armor_bound.hh"
+#include "armor_catalogue.hh"
+#include "armor_columns.hh"
+#include "armor_delta.hh"
+#include "armor_dp.hh"
+#include "armor_exact.hh"
+#include "armor_follow.hh"
+#include "armor_generic.hh"
+#include "armor_profile.hh"
+#include "armor_selectivity.hh"
+#include "armor_solver.hh"
+#include "armor_static.hh"
+#include "armor_writer.hh"
 #include "maxtime.hh"
 #include "rubrictest.hh"
 
 
+// The first rows of ride.csv, solved by the compiler.
+constexpr auto static_armors = make_static_armor_table({
+	{ "used high-quality mystical human chest plate", 609.3, 481.1 },
+	{ "deteriorating poor quality enchanted elf shield", 824.94, 551.95 },
+	{ "like-new master-quality magic orc shield", 711.07, 504.82 },
+	{ "used poor quality unlucky human boots", 384.79, 536.41 },
+	{ "used hardened enchanted orc gloves", 344.19, 359.88 },
+	{ "brittle master-quality divine human shield", 977.98, 470.66 },
+	{ "worn poor quality enchanted dwarf chest plate", 467.34, 515.26 },
+	{ "brittle sub-par quality unlucky human helmet", 592.21, 734.78 },
+	{ "used regular regular elf belt", 140.17, 137.43 },
+	{ "like-new poor quality mystical dwarf boots", 458.8, 301.93 },
+	{ "brittle sub-par quality cursed human shield", 820.14, 394.92 },
+	{ "new high-quality unlucky dwarf boots", 372.09, 363.52 }
+});
+static_assert(static_armor_table_valid(static_armors), "invalid static armor table");
+constexpr auto static_greedy = greedy_max_defense_static(static_armors, 1500.0);
+constexpr auto static_exhaustive = exhaustive_max_defense_static(static_armors, 1500.0);
+static_assert(static_exhaustive.cost <= 1500.0 && static_exhaustive.defense >= static_greedy.defense, "exhaustive beats greedy");
+
+
 int main()
 {
 	Rubric rubric;
@@ -57,6 +99,1414 @@ int main()
 		}
 	);
 
+	//
+	rubric.criterion(
+		"filter_armor_database out-of-core", 2,
+		[&]()
+		{
+			auto expected = filter_armor_vector(*all_armors, 100, 500, 10);
+			auto from_csv = filter_armor_database("ride.csv", 100, 500, 10, 7);
+			TEST_TRUE("non-null", from_csv);
+			TEST_EQUAL("total_size", expected->size(), from_csv->size());
+			for (size_t i = 0; i < expected->size(); i++) {
+				TEST_EQUAL("contents", (*expected)[i]->description(), (*from_csv)[i]->description());
+			}
+
+			const std::string snapshot_path = "maxtime_test.snapshot";
+			TEST_TRUE("save snapshot", save_armor_snapshot(*all_armors, snapshot_path));
+			auto reloaded = load_armor_database(snapshot_path);
+			auto from_snapshot = filter_armor_database(snapshot_path, 1, 2500, all_armors->size(), 1000);
+			std::remove(snapshot_path.c_str());
+
+			TEST_TRUE("non-null", reloaded);
+			TEST_TRUE("non-null", from_snapshot);
+			TEST_EQUAL("snapshot size", all_armors->size(), reloaded->size());
+			TEST_EQUAL("snapshot filter size", filtered_armors->size(), from_snapshot->size());
+			for (size_t i = 0; i < filtered_armors->size(); i++) {
+				TEST_EQUAL("contents", (*filtered_armors)[i]->description(), (*from_snapshot)[i]->description());
+				TEST_EQUAL("cost", (*filtered_armors)[i]->cost(), (*from_snapshot)[i]->cost());
+			}
+
+			TEST_FALSE("missing file", filter_armor_database("no_such_file.csv", 1, 2500, 10));
+		}
+	);
+
+	//
+	rubric.criterion(
+		"scan_armor_database early exit", 1,
+		[&]()
+		{
+			size_t chunks = 0, rows = 0;
+			bool ok = scan_armor_database(
+				"ride.csv", 16,
+				[&](const ArmorVector& chunk)
+				{
+					chunks++;
+					rows += chunk.size();
+					return chunks < 3;
+				}
+			);
+			TEST_TRUE("stopping early is not an error", ok);
+			TEST_EQUAL("chunks visited", 3, chunks);
+			TEST_EQUAL("rows visited", 48, rows);
+
+			auto prefix = filter_armor_database("ride.csv", 1, 2500, 20);
+			TEST_TRUE("non-null", prefix);
+			TEST_EQUAL("total_size", 20, prefix->size());
+			for (size_t i = 0; i < prefix->size(); i++) {
+				TEST_EQUAL("contents", (*filtered_armors)[i]->description(), (*prefix)[i]->description());
+			}
+			TEST_TRUE("empty query", filter_armor_database("ride.csv", 1, 2500, 0)->empty());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"gzip-compressed databases", 2,
+		[&]()
+		{
+			auto gzip_file = [](const std::string& from, const std::string& to, size_t max_bytes)
+			{
+				std::ifstream in(from, std::ios::binary);
+				std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+				gzFile out = gzopen(to.c_str(), "wb");
+				gzwrite(out, bytes.data(), bytes.size());
+				gzclose(out);
+
+				// Truncate the compressed file to simulate corruption.
+				std::ifstream compressed(to, std::ios::binary);
+				std::string gz((std::istreambuf_iterator<char>(compressed)), std::istreambuf_iterator<char>());
+				compressed.close();
+				std::ofstream(to, std::ios::binary | std::ios::trunc).write(gz.data(), std::min(gz.size(), max_bytes));
+			};
+
+			const std::string
+				csv_gz = "maxtime_test.csv.gz",
+				snapshot = "maxtime_test.snapshot",
+				snapshot_gz = "maxtime_test.snapshot.gz",
+				truncated_gz = "maxtime_test.truncated.gz"
+				;
+			gzip_file("ride.csv", csv_gz, SIZE_MAX);
+			gzip_file("ride.csv", truncated_gz, 50000);
+			save_armor_snapshot(*all_armors, snapshot);
+			gzip_file(snapshot, snapshot_gz, SIZE_MAX);
+
+			auto from_csv_gz = load_armor_database(csv_gz);
+			auto from_snapshot_gz = load_armor_database(snapshot_gz);
+			auto prefix = filter_armor_database(csv_gz, 1, 2500, 20);
+			auto truncated = load_armor_database(truncated_gz);
+			auto truncated_prefix = filter_armor_database(truncated_gz, 1, 2500, 20);
+
+			for (auto& path : { csv_gz, snapshot, snapshot_gz, truncated_gz }) {
+				std::remove(path.c_str());
+			}
+
+			TEST_TRUE("non-null", from_csv_gz);
+			TEST_TRUE("non-null", from_snapshot_gz);
+			TEST_EQUAL("size", all_armors->size(), from_csv_gz->size());
+			TEST_EQUAL("size", all_armors->size(), from_snapshot_gz->size());
+			for (size_t i = 0; i < all_armors->size(); i++) {
+				TEST_EQUAL("contents", (*all_armors)[i]->description(), (*from_csv_gz)[i]->description());
+				TEST_EQUAL("contents", (*all_armors)[i]->defense(), (*from_snapshot_gz)[i]->defense());
+			}
+
+			TEST_TRUE("non-null", prefix);
+			TEST_EQUAL("prefix", 20, prefix->size());
+			TEST_FALSE("truncated", truncated);
+			TEST_TRUE("truncated prefix still readable", truncated_prefix && truncated_prefix->size() == 20);
+		}
+	);
+
+	//
+	rubric.criterion(
+		"ArmorDeltaLog updates and compaction", 2,
+		[&]()
+		{
+			const std::string
+				base_path = "maxtime_test.base",
+				log_path = "maxtime_test.deltas",
+				compacted_path = "maxtime_test.compacted"
+				;
+			ArmorVector base(all_armors->begin(), all_armors->begin() + 5);
+			save_armor_snapshot(base, base_path);
+			std::remove(log_path.c_str());
+
+			ArmorDeltaLog log(base_path, log_path);
+			std::string
+				first = base[0]->description(),
+				second = base[1]->description(),
+				third = base[2]->description()
+				;
+			TEST_TRUE("append", log.append({ ArmorDeltaOp::set_cost, first, 10.0, 0 }));
+			TEST_TRUE("append", log.append({ ArmorDeltaOp::remove, second, 0, 0 }));
+			TEST_TRUE("append", log.append({ ArmorDeltaOp::add, "test shield", 50.0, 60.0 }));
+			TEST_TRUE("append", log.append({ ArmorDeltaOp::set_defense, third, 0, 1.5 }));
+			TEST_TRUE("append", log.append({ ArmorDeltaOp::remove, "no such item", 0, 0 }));
+			TEST_FALSE("invalid cost", log.append({ ArmorDeltaOp::set_cost, first, -1.0, 0 }));
+
+			std::set<std::string> touched;
+			auto updated = log.load(&touched);
+			TEST_TRUE("non-null", updated);
+			TEST_EQUAL("size", 5, updated->size());
+			TEST_EQUAL("cost changed", 10.0, (*updated)[0]->cost());
+			TEST_EQUAL("defense kept", base[0]->defense(), (*updated)[0]->defense());
+			TEST_EQUAL("order kept", third, (*updated)[1]->description());
+			TEST_EQUAL("defense changed", 1.5, (*updated)[1]->defense());
+			TEST_EQUAL("added at end", "test shield", (*updated)[4]->description());
+			TEST_EQUAL("touched", std::set<std::string>({ first, second, third, "test shield" }), touched);
+			TEST_EQUAL("base untouched", 5, load_armor_database(base_path)->size());
+
+			TEST_TRUE("compact", log.compact_async(compacted_path).get());
+			TEST_EQUAL("new base", compacted_path, log.base_path());
+			TEST_TRUE("append after compaction", log.append({ ArmorDeltaOp::set_cost, "test shield", 55.0, 0 }));
+
+			auto compacted = load_armor_database(compacted_path);
+			auto reloaded = log.load(&touched);
+
+			// A restarted process given the original base finds the new one
+			// in the log, and never compacts over the base it reads.
+			ArmorDeltaLog restarted(base_path, log_path);
+			auto restarted_armors = restarted.load();
+			TEST_EQUAL("restart base", compacted_path, restarted.base_path());
+			TEST_TRUE("restart non-null", restarted_armors);
+			TEST_EQUAL("restart contents", 55.0, restarted_armors ? (*restarted_armors)[4]->cost() : 0.0);
+			TEST_FALSE("compact over base", log.compact(compacted_path));
+
+			// Concurrent compactions, with appends in between, lose no record.
+			std::vector<std::future<bool>> compactions;
+			std::vector<std::string> concurrent_paths;
+			for (int k = 0; k < 32; k++) {
+				log.append({ ArmorDeltaOp::add, "test concurrent " + std::to_string(k), 1.0, 1.0 });
+				concurrent_paths.push_back(compacted_path + std::to_string(k));
+				compactions.push_back(log.compact_async(concurrent_paths.back()));
+			}
+			bool all_compacted = true;
+			for (auto& compaction : compactions) {
+				all_compacted = compaction.get() && all_compacted;
+			}
+			auto concurrent = log.load();
+			for (auto& path : concurrent_paths) {
+				std::remove(path.c_str());
+			}
+			for (auto& path : { base_path, log_path, compacted_path }) {
+				std::remove(path.c_str());
+			}
+			TEST_TRUE("concurrent compactions", all_compacted);
+			TEST_TRUE("concurrent non-null", concurrent);
+			TEST_EQUAL("concurrent appends kept", 37, concurrent ? concurrent->size() : 0);
+
+			TEST_TRUE("non-null", compacted);
+			TEST_EQUAL("compacted size", 5, compacted->size());
+			TEST_EQUAL("compacted contents", 10.0, (*compacted)[0]->cost());
+			TEST_EQUAL("only new deltas touched", std::set<std::string>({ "test shield" }), touched);
+			TEST_EQUAL("reloaded", 55.0, (*reloaded)[4]->cost());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"ArmorFollower tail-follow", 2,
+		[&]()
+		{
+			const std::string path = "maxtime_test.follow.csv";
+			std::ofstream(path) << "Item^Cost^Defense\nhelmet^100^20\nboots^40^5\n";
+
+			size_t appended_total = 0, rewrites = 0;
+			ArmorFollower follower(path);
+			follower.on_append(
+				[&](const ArmorVector& appended, uint64_t, bool rewritten) {
+					appended_total = rewritten ? appended.size() : appended_total + appended.size();
+					rewrites += rewritten;
+				}
+			);
+			bool started = follower.start();
+
+			auto first = follower.current();
+			size_t initial_size = first->size();
+			{
+				std::ofstream f(path, std::ios::app);
+				f << "shield^50^30\nbroken row\ngloves^2";
+			}
+			bool polled = follower.poll();
+			auto second = follower.current();
+			uint64_t second_version = follower.version();
+
+			std::ofstream(path, std::ios::app) << "0^10\n";
+			for (int i = 0; i < 200 && follower.version() == second_version; i++) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			auto third = follower.current();
+			size_t third_total = appended_total;
+
+			// Replace the file atomically, as an editor or exporter would.
+			std::ofstream(path + ".tmp") << "Item^Cost^Defense\ncloak^30^7\n";
+			std::rename((path + ".tmp").c_str(), path.c_str());
+			for (int i = 0; i < 200 && follower.version() == 3; i++) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			auto replaced = follower.current();
+			follower.stop();
+			std::remove(path.c_str());
+
+			TEST_TRUE("start", started);
+			TEST_TRUE("poll", polled);
+			TEST_EQUAL("initial load", 2, initial_size);
+			TEST_EQUAL("old version unchanged", 2, first->size());
+			TEST_EQUAL("complete rows only", 3, second->size());
+			TEST_EQUAL("appended row", "shield", (*second)[2]->description());
+			TEST_EQUAL("malformed row counted", 1, follower.malformed_rows());
+			TEST_EQUAL("watcher picked up rest of row", 4, third->size());
+			TEST_EQUAL("split row", 20.0, (*third)[3]->cost());
+			TEST_TRUE("items shared between versions", (*first)[1] == (*third)[1]);
+			TEST_EQUAL("as a vector", "gloves", (*third->armors())[3]->description());
+			TEST_EQUAL("appended callbacks", 4, third_total);
+			TEST_EQUAL("rename noticed", 1, replaced->size());
+			TEST_EQUAL("reloaded", "cloak", (*replaced)[0]->description());
+			TEST_EQUAL("old versions kept", "gloves", (*third)[3]->description());
+			TEST_EQUAL("rewrite signalled", 1, rewrites);
+			TEST_EQUAL("subscriber reset", 1, appended_total);
+			TEST_EQUAL("versions", 4, follower.version());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"profile_armor_vector", 2,
+		[&]()
+		{
+			ArmorVector armors = trivial_armors;
+			armors.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("test boots again", 40.0, 5.0)));
+			armors.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("test ring", 0.25, 0.0)));
+
+			auto profile = profile_armor_vector(armors);
+			TEST_EQUAL("count", 4, profile.count);
+			TEST_EQUAL("non-positive defense", 1, profile.non_positive_defense);
+			TEST_EQUAL("duplicate pairs", 1, profile.duplicate_pairs);
+			TEST_EQUAL("duplicate descriptions", 0, profile.duplicate_descriptions);
+			TEST_EQUAL("cost decimals", 2, profile.cost.decimals);
+			TEST_EQUAL("defense decimals", 0, profile.defense.decimals);
+			TEST_EQUAL("cost min", 0.25, profile.cost.min);
+			TEST_EQUAL("ratio max", 0.2, profile.ratio.max);
+			TEST_GT("correlated", profile.correlation, 0.9);
+
+			auto full = profile_armor_vector(*all_armors);
+			TEST_EQUAL("catalogue size", all_armors->size(), full.count);
+			TEST_EQUAL("cent precision", 2, full.cost.decimals);
+			TEST_EQUAL("quantile count", ARMOR_PROFILE_QUANTILES.size(), full.cost.quantiles.size());
+
+			std::vector<double> costs;
+			for (auto& armor : *all_armors) {
+				costs.push_back(armor->cost());
+			}
+			std::sort(costs.begin(), costs.end());
+			for (size_t i = 0; i < ARMOR_PROFILE_QUANTILES.size(); i++) {
+				double exact = costs[size_t(ARMOR_PROFILE_QUANTILES[i] * (costs.size() - 1))];
+				double approximate = full.cost.quantiles[i];
+				size_t rank = std::lower_bound(costs.begin(), costs.end(), approximate) - costs.begin();
+				size_t exact_rank = std::lower_bound(costs.begin(), costs.end(), exact) - costs.begin();
+				TEST_LT("sketch rank error", std::abs(double(rank) - double(exact_rank)), 0.03 * costs.size());
+			}
+
+			std::stringstream json;
+			write_armor_profile_json(profile, json);
+			TEST_EQUAL("json", 0, json.str().find("{\"count\":4,"));
+
+			ArmorVector clustered, thirds, uncorrelated;
+			for (int i = 1; i <= 3; i++) {
+				clustered.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("clustered", 1e9 + i, i)));
+				thirds.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("third", i / 3.0, i)));
+				uncorrelated.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("uncorrelated", i, 4 - i)));
+			}
+			auto tight = profile_armor_vector(clustered);
+			TEST_LT("clustered stddev", std::fabs(tight.cost.stddev - std::sqrt(2.0 / 3.0)), 1e-6);
+			TEST_LT("clustered correlation", std::fabs(tight.correlation - 1.0), 1e-9);
+			TEST_EQUAL("exact costs", 0, tight.inexact_costs);
+			TEST_EQUAL("inexact costs", 2, profile_armor_vector(thirds).inexact_costs);
+
+			TEST_EQUAL("correlated to tree_dp", "tree_dp", armor_exact_solver_for(profile));
+			TEST_EQUAL("inexact to branch_and_bound", "branch_and_bound", armor_exact_solver_for(profile_armor_vector(thirds)));
+			TEST_EQUAL("uncorrelated to branch_and_bound", "branch_and_bound", armor_exact_solver_for(profile_armor_vector(uncorrelated)));
+
+			ArmorQuery query;
+			query.min_defense = 1;
+			query.max_defense = 100;
+			query.total_size = 100;
+			query.budget = 80;
+			query.algorithm = ARMOR_AUTO_SOLVER;
+			ArmorSolveContext context;
+			auto chosen = solve_armor_query(armors, query, context);
+			TEST_EQUAL("auto solved with tree_dp", 0, context.path.find("tree_dp"));
+			TEST_EQUAL("auto optimal", "test boots again", (*chosen)[1]->description());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"float32 column kernels", 3,
+		[&]()
+		{
+			auto columns_f = make_armor_columns<float>(*all_armors);
+			auto columns_d = make_armor_columns<double>(*all_armors);
+			for (int total_size : { 3, 100, 10000 }) {
+				auto expected = filter_armor_vector(*all_armors, 100, 500, total_size);
+				auto actual = filter_armor_columns(columns_f, *all_armors, 100, 500, total_size);
+				TEST_EQUAL("filter size", expected->size(), actual->size());
+				for (size_t i = 0; i < expected->size(); i++) {
+					TEST_EQUAL("filter contents", (*expected)[i]->description(), (*actual)[i]->description());
+				}
+			}
+
+			auto filtered_f = make_armor_columns<float>(*filtered_armors);
+			auto filtered_d = make_armor_columns<double>(*filtered_armors);
+			for (double budget : { 500.0, 5000.0 }) {
+				auto expected = greedy_max_defense(*filtered_armors, budget);
+				auto exact = greedy_max_defense_columns(filtered_d, *filtered_armors, budget);
+				auto reduced = greedy_max_defense_columns(filtered_f, *filtered_armors, budget);
+				double expected_cost, expected_defense, reduced_cost, reduced_defense;
+				sum_armor_vector(*expected, expected_cost, expected_defense);
+				sum_armor_vector(*reduced, reduced_cost, reduced_defense);
+				TEST_EQUAL("double greedy size", expected->size(), exact->size());
+				for (size_t i = 0; i < expected->size(); i++) {
+					TEST_EQUAL("double greedy contents", (*expected)[i]->description(), (*exact)[i]->description());
+				}
+				TEST_TRUE("float greedy fits", reduced_cost <= budget);
+				TEST_LT("float greedy close", std::fabs(reduced_defense - expected_defense), 0.01 * expected_defense);
+			}
+
+			for (int n = 1; n <= 20; n++) {
+				auto small_armors = filter_armor_vector(*filtered_armors, 1, 2000, n);
+				auto small_f = make_armor_columns<float>(*small_armors);
+				auto small_d = make_armor_columns<double>(*small_armors);
+				double budget = 2000;
+				auto expected = exhaustive_max_defense(*small_armors, budget);
+				double expected_cost, expected_defense;
+				sum_armor_vector(*expected, expected_cost, expected_defense);
+				std::vector<std::shared_ptr<ArmorVector>> solutions =
+				{
+					exhaustive_max_defense_columns(small_f, *small_armors, budget),
+					exhaustive_max_defense_columns(small_d, *small_armors, budget)
+				};
+				for (auto& solution : solutions) {
+					double cost, defense;
+					sum_armor_vector(*solution, cost, defense);
+					TEST_TRUE("exhaustive fits", cost <= budget);
+					TEST_LT("exhaustive optimal", std::fabs(defense - expected_defense), 1e-3);
+				}
+			}
+
+			// A subset that exactly fills the budget must not be lost to rounding.
+			ArmorVector exact_fit;
+			exact_fit.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("a", 0.1, 1.0)));
+			exact_fit.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("b", 0.2, 1.0)));
+			exact_fit.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("c", 0.7, 1.0)));
+			auto fit = exhaustive_max_defense_columns(make_armor_columns<float>(exact_fit), exact_fit, 1.0);
+			TEST_EQUAL("exact fit", exhaustive_max_defense(exact_fit, 1.0)->size(), fit->size());
+			TEST_TRUE("exact fit feasible", armor_solution_fits(*fit, 1.0));
+		}
+	);
+
+	//
+	rubric.criterion(
+		"16-bit quantised pre-filter", 2,
+		[&]()
+		{
+			auto quantized = make_armor_quantized_columns(*all_armors);
+			TEST_EQUAL("rows", all_armors->size(), quantized.size());
+
+			struct Query { double min_defense, max_defense; int total_size; double max_cost; };
+			std::vector<Query> queries =
+			{
+				{ 100, 500, 10, INFINITY },
+				{ 100, 500, 100000, INFINITY },
+				{ -1000, 100000, 100000, INFINITY },
+				{ 0, 0.5, 100000, INFINITY },
+				{ 1, 2500, 100000, 300 },
+				{ 481.1, 481.1, 100000, INFINITY },
+				{ 500, 100, 100000, INFINITY }
+			};
+			for (auto& query : queries) {
+				auto expected = filter_armor_vector(*all_armors, query.min_defense, query.max_defense, all_armors->size());
+				ArmorVector affordable;
+				for (auto& armor : *expected) {
+					if (int(affordable.size()) < query.total_size && armor->cost() <= query.max_cost) {
+						affordable.push_back(armor);
+					}
+				}
+				auto actual = filter_armor_quantized(quantized, *all_armors, query.min_defense, query.max_defense, query.total_size, query.max_cost);
+				TEST_EQUAL("filter size", affordable.size(), actual->size());
+				for (size_t i = 0; i < affordable.size(); i++) {
+					TEST_EQUAL("filter contents", affordable[i]->description(), (*actual)[i]->description());
+				}
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"conflict-aware exact search", 3,
+		[&]()
+		{
+			for (int n : { 0, 1, 12, 18 }) {
+				auto items = filter_armor_vector(*filtered_armors, 1, 2500, n);
+				double budget = 3000;
+
+				ArmorConflicts conflicts;
+				for (int i = 0; i + 1 < n; i += 2) {
+					add_armor_conflict(conflicts, i, i + 1);
+				}
+				for (int i = 0; i + 5 < n; i += 3) {
+					add_armor_conflict(conflicts, i, i + 5);
+				}
+
+				// Reference: every compatible subset, checked by brute force.
+				double expected = 0;
+				for (uint64_t mask = 0; mask < (uint64_t(1) << n); mask++) {
+					double cost = 0, defense = 0;
+					for (int i = 0; i < n; i++) {
+						if (mask >> i & 1) {
+							cost += (*items)[i]->cost();
+							defense += (*items)[i]->defense();
+						}
+					}
+					if (cost <= budget && armor_subset_compatible(conflicts, mask)) {
+						expected = std::max(expected, defense);
+					}
+				}
+
+				std::vector<std::shared_ptr<ArmorVector>> solutions =
+				{
+					exhaustive_max_defense_conflicts(*items, budget, conflicts),
+					branch_and_bound_max_defense(*items, budget, conflicts)
+				};
+				for (auto& solution : solutions) {
+					double cost, defense;
+					sum_armor_vector(*solution, cost, defense);
+					uint64_t mask = 0;
+					for (auto& armor : *solution) {
+						mask |= uint64_t(1) << (std::find(items->begin(), items->end(), armor) - items->begin());
+					}
+					TEST_TRUE("fits", cost <= budget);
+					TEST_TRUE("compatible", armor_subset_compatible(conflicts, mask));
+					TEST_LT("optimal", std::fabs(defense - expected), 1e-6);
+				}
+
+				double unconstrained_cost, unconstrained, bnb_cost, bnb;
+				sum_armor_vector(*exhaustive_max_defense(*items, budget), unconstrained_cost, unconstrained);
+				sum_armor_vector(*branch_and_bound_max_defense(*items, budget), bnb_cost, bnb);
+				TEST_LT("branch and bound without conflicts", std::fabs(bnb - unconstrained), 1e-6);
+			}
+
+			const std::string path = "maxtime_test.conflicts";
+			std::ofstream(path)
+				<< "Item^Item\n"
+				<< "test helmet^test boots\n"
+				<< "test helmet^filtered out item\n"
+				;
+			auto loaded = load_armor_conflicts(path, trivial_armors);
+			std::ofstream(path) << "Item^Item\ntest helmet\n";
+			auto malformed = load_armor_conflicts(path, trivial_armors);
+			std::remove(path.c_str());
+
+			TEST_TRUE("non-null", loaded);
+			TEST_EQUAL("helmet conflicts", 2, armor_conflicts_of(*loaded, 0));
+			TEST_EQUAL("boots conflicts", 1, armor_conflicts_of(*loaded, 1));
+			TEST_FALSE("malformed", malformed);
+			TEST_EQUAL("one of the pair", 1, branch_and_bound_max_defense(trivial_armors, 1000, *loaded)->size());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"tree-knapsack dependencies", 3,
+		[&]()
+		{
+			for (int n : { 0, 1, 12, 18 }) {
+				auto items = filter_armor_vector(*filtered_armors, 1, 2500, n);
+				double budget = 2500;
+
+				// Chains and branches: item i upgrades item i / 2 unless i % 3 == 0.
+				ArmorDependencies dependencies(n, -1);
+				for (int i = 1; i < n; i++) {
+					if (i % 3) {
+						dependencies[i] = i / 2;
+					}
+				}
+
+				double expected = 0;
+				for (uint64_t mask = 0; mask < (uint64_t(1) << n); mask++) {
+					double cost = 0, defense = 0;
+					for (int i = 0; i < n; i++) {
+						if (mask >> i & 1) {
+							cost += (*items)[i]->cost();
+							defense += (*items)[i]->defense();
+						}
+					}
+					if (cost <= budget && armor_subset_closed(dependencies, mask)) {
+						expected = std::max(expected, defense);
+					}
+				}
+
+				auto solution = tree_knapsack_max_defense(*items, budget, dependencies);
+				double cost, defense;
+				sum_armor_vector(*solution, cost, defense);
+				uint64_t mask = 0;
+				for (auto& armor : *solution) {
+					mask |= uint64_t(1) << (std::find(items->begin(), items->end(), armor) - items->begin());
+				}
+				TEST_TRUE("fits", cost <= budget);
+				TEST_TRUE("closed", armor_subset_closed(dependencies, mask));
+				TEST_LT("optimal", std::fabs(defense - expected), 1e-6);
+
+				double unconstrained_cost, unconstrained, free_cost, free_defense;
+				sum_armor_vector(*exhaustive_max_defense(*items, budget), unconstrained_cost, unconstrained);
+				sum_armor_vector(*tree_knapsack_max_defense(*items, budget), free_cost, free_defense);
+				TEST_LT("no dependencies", std::fabs(free_defense - unconstrained), 1e-6);
+			}
+
+			TEST_EQUAL("scale", 100, armor_cost_scale(*all_armors));
+			TEST_EQUAL("scale", 1, armor_cost_scale(trivial_armors));
+
+			const std::string path = "maxtime_test.dependencies";
+			std::ofstream(path) << "Upgrade^Requires\ntest boots^test helmet\nfiltered out item^test helmet\n";
+			auto loaded = load_armor_dependencies(path, trivial_armors);
+			std::ofstream(path) << "Upgrade^Requires\ntest boots^test helmet\ntest helmet^test boots\n";
+			auto cycle = load_armor_dependencies(path, trivial_armors);
+			std::ofstream(path) << "Upgrade^Requires\ntest boots^filtered out base\n";
+			auto missing_base = load_armor_dependencies(path, trivial_armors);
+			std::ofstream(path) << "Upgrade^Requires\ntest boots^test helmet\ntest helmet^filtered out base\n";
+			auto missing_root = load_armor_dependencies(path, trivial_armors);
+			std::remove(path.c_str());
+
+			TEST_TRUE("non-null", loaded);
+			TEST_EQUAL("loaded", ArmorDependencies({ -1, 0 }), *loaded);
+			TEST_FALSE("cycle", cycle);
+			TEST_EQUAL("upgrade needs base", 0, tree_knapsack_max_defense(trivial_armors, 99, *loaded)->size());
+			TEST_EQUAL("base alone", 1, tree_knapsack_max_defense(trivial_armors, 100, *loaded)->size());
+
+			TEST_TRUE("missing base", missing_base);
+			TEST_EQUAL("missing base", ArmorDependencies({ -1, ARMOR_UNAVAILABLE_BASE }), *missing_base);
+			TEST_FALSE("missing base closed", armor_subset_closed(*missing_base, 2));
+			auto without_upgrade = tree_knapsack_max_defense(trivial_armors, 1000, *missing_base);
+			TEST_EQUAL("missing base unbuyable", 1, without_upgrade->size());
+			TEST_TRUE("missing base unbuyable", without_upgrade->size() == 1 && (*without_upgrade)[0] == trivial_armors[0]);
+			TEST_TRUE("missing root", missing_root);
+			TEST_EQUAL("missing root unbuyable", 0, tree_knapsack_max_defense(trivial_armors, 1000, *missing_root)->size());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"at-most-k exhaustive", 2,
+		[&]()
+		{
+			auto items = filter_armor_vector(*filtered_armors, 1, 2500, 14);
+			double budget = 3000;
+			for (int k = 0; k <= 15; k++) {
+				double expected = 0;
+				uint64_t visited = 0;
+				for (uint64_t mask = 0; mask < (uint64_t(1) << items->size()); mask++) {
+					if (__builtin_popcountll(mask) > k) {
+						continue;
+					}
+					visited++;
+					double cost = 0, defense = 0;
+					for (size_t i = 0; i < items->size(); i++) {
+						if (mask >> i & 1) {
+							cost += (*items)[i]->cost();
+							defense += (*items)[i]->defense();
+						}
+					}
+					if (cost <= budget) {
+						expected = std::max(expected, defense);
+					}
+				}
+
+				auto solution = exhaustive_max_defense_at_most(*items, budget, k);
+				double cost, defense;
+				sum_armor_vector(*solution, cost, defense);
+				TEST_TRUE("at most k", int(solution->size()) <= k);
+				TEST_TRUE("fits", cost <= budget);
+				TEST_LT("optimal", std::fabs(defense - expected), 1e-6);
+				TEST_EQUAL("subsets visited", visited, armor_subsets_at_most(items->size(), k));
+			}
+
+			auto large = filter_armor_vector(*filtered_armors, 1, 2500, 63);
+			auto pairs = exhaustive_max_defense_at_most(*large, 2500, 2);
+			TEST_TRUE("n = 63", pairs->size() <= 2 && armor_solution_fits(*pairs, 2500));
+			TEST_EQUAL("C(63, 2) + 63 + 1", 2017, armor_subsets_at_most(63, 2));
+			TEST_EQUAL("saturates", UINT64_MAX, armor_subsets_at_most(200, 100));
+		}
+	);
+
+	//
+	rubric.criterion(
+		"maximal subset enumeration", 2,
+		[&]()
+		{
+			for (int n : { 0, 1, 10, 16 }) {
+				auto items = filter_armor_vector(*filtered_armors, 1, 2500, n);
+				for (double budget : { 0.0, 500.0, 3000.0, 1e9 }) {
+					uint64_t maximal = 0;
+					for (uint64_t mask = 0; mask < (uint64_t(1) << n); mask++) {
+						double cost = 0;
+						for (int i = 0; i < n; i++) {
+							cost += (mask >> i & 1) ? (*items)[i]->cost() : 0;
+						}
+						bool is_maximal = cost <= budget;
+						for (int i = 0; i < n && is_maximal; i++) {
+							is_maximal = (mask >> i & 1) || cost + (*items)[i]->cost() > budget;
+						}
+						maximal += is_maximal;
+					}
+
+					uint64_t evaluated = 0;
+					auto solution = maximal_max_defense(*items, budget, &evaluated);
+					double cost, defense, expected_cost, expected_defense;
+					sum_armor_vector(*solution, cost, defense);
+					sum_armor_vector(*exhaustive_max_defense(*items, budget), expected_cost, expected_defense);
+					TEST_TRUE("fits", cost <= budget);
+					TEST_LT("optimal", std::fabs(defense - expected_defense), 1e-6);
+					TEST_EQUAL("only maximal subsets", maximal, evaluated);
+				}
+			}
+
+			ArmorVector with_useless = trivial_armors;
+			with_useless.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("test ring", 1.0, 0.0)));
+			auto solution = maximal_max_defense(with_useless, 1000);
+			TEST_EQUAL("zero defense left out", 2, solution->size());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"Dantzig bound and optimality gap", 2,
+		[&]()
+		{
+			// Reference: the bound by a full sort.
+			auto sorted_bound = [](const ArmorVector& armors, double budget)
+			{
+				ArmorVector sorted;
+				for (auto& armor : armors) {
+					if (armor->defense() > 0) {
+						sorted.push_back(armor);
+					}
+				}
+				std::stable_sort(sorted.begin(), sorted.end(), [](const std::shared_ptr<ArmorItem>& a, const std::shared_ptr<ArmorItem>& b) {
+					return a->defense() / a->cost() > b->defense() / b->cost();
+				});
+				double bound = 0;
+				for (auto& armor : sorted) {
+					if (armor->cost() <= budget) {
+						budget -= armor->cost();
+						bound += armor->defense();
+					} else {
+						return bound + armor->defense() * budget / armor->cost();
+					}
+				}
+				return bound;
+			};
+
+			for (double budget : { 0.0, 1.0, 500.0, 2500.0, 1e5, 1e9 }) {
+				double expected = sorted_bound(*all_armors, budget);
+				TEST_LT("bound", std::fabs(dantzig_upper_bound(*all_armors, budget) - expected), 1e-9 * std::max(1.0, expected));
+			}
+
+			ArmorVector ties;
+			for (int i = 0; i < 5; i++) {
+				ties.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("tie " + std::to_string(i), 10.0, 20.0)));
+			}
+			ties.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("useless", 1.0, -5.0)));
+			TEST_EQUAL("equal ratios", 70.0, dantzig_upper_bound(ties, 35.0));
+			TEST_EQUAL("all fit", 100.0, dantzig_upper_bound(ties, 1000.0));
+
+			for (int n : { 5, 12, 18 }) {
+				auto items = filter_armor_vector(*filtered_armors, 1, 2500, n);
+				auto greedy = greedy_max_defense(*items, 2500);
+				auto exhaustive = exhaustive_max_defense(*items, 2500);
+				auto greedy_gap = armor_solution_gap(*items, 2500, *greedy);
+				auto exhaustive_gap = armor_solution_gap(*items, 2500, *exhaustive);
+				TEST_TRUE("bound above optimum", exhaustive_gap.upper_bound >= exhaustive_gap.defense - 1e-9);
+				TEST_TRUE("greedy gap at least optimum's", greedy_gap.relative() >= exhaustive_gap.relative() - 1e-12);
+				TEST_TRUE("gap in range", greedy_gap.relative() >= 0 && greedy_gap.relative() < 1);
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"local search and FPTAS", 2,
+		[&]()
+		{
+			for (int n : { 0, 1, 12, 60 }) {
+				auto items = filter_armor_vector(*filtered_armors, 1, 2500, n);
+				for (double budget : { 0.0, 300.0, 2500.0 }) {
+					double optimum_cost, optimum, greedy_cost, greedy;
+					sum_armor_vector(*tree_knapsack_max_defense(*items, budget), optimum_cost, optimum);
+					sum_armor_vector(*greedy_max_defense(*items, budget), greedy_cost, greedy);
+
+					auto improved = greedy_local_search_max_defense(*items, budget);
+					double improved_cost, improved_defense;
+					sum_armor_vector(*improved, improved_cost, improved_defense);
+					TEST_TRUE("local search fits", improved_cost <= budget);
+					TEST_TRUE("local search no worse than greedy", improved_defense >= greedy - 1e-9);
+					TEST_TRUE("local search no better than optimal", improved_defense <= optimum + 1e-9);
+
+					for (double epsilon : { 0.5, 0.1, 0.01 }) {
+						double cost, defense;
+						sum_armor_vector(*fptas_max_defense(*items, budget, epsilon), cost, defense);
+						TEST_TRUE("fptas fits", cost <= budget);
+						TEST_TRUE("fptas within epsilon", defense >= (1 - epsilon) * optimum - 1e-9);
+					}
+				}
+			}
+
+			// Greedy takes the best ratio first and then cannot afford the big item.
+			ArmorVector trap;
+			trap.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("small", 1.0, 2.0)));
+			trap.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("big", 10.0, 10.0)));
+			TEST_EQUAL("greedy trapped", "small", (*greedy_max_defense(trap, 10.0))[0]->description());
+			auto escaped = greedy_local_search_max_defense(trap, 10.0);
+			TEST_EQUAL("local search escapes", "big", (*escaped)[0]->description());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"every registered solver", 3,
+		[&]()
+		{
+			TEST_TRUE("built-ins registered", find_armor_solver("greedy") && find_armor_solver("exhaustive"));
+			TEST_FALSE("unknown", find_armor_solver("no such solver"));
+
+			for (int n : { 0, 1, 8, 15 }) {
+				auto items = filter_armor_vector(*filtered_armors, 1, 2500, n);
+				for (double budget : { 0.0, 300.0, 2500.0 }) {
+					double optimum_cost, optimum;
+					sum_armor_vector(*exhaustive_max_defense(*items, budget), optimum_cost, optimum);
+
+					for (auto& solver : armor_solvers()) {
+						if (size_t(n) > solver.capabilities().fast_n) {
+							continue;
+						}
+						ArmorSolveContext context;
+						context.epsilon = 0.05;
+						auto solution = solver.solve(*items, budget, context);
+						double cost, defense;
+						sum_armor_vector(*solution, cost, defense);
+						TEST_TRUE(solver.name() + " fits", cost <= budget);
+						TEST_TRUE(solver.name() + " no better than optimal", defense <= optimum + 1e-9);
+						TEST_EQUAL(solver.name() + " gap defense", defense, context.gap.defense);
+						TEST_GE(solver.name() + " gap bound", context.gap.upper_bound, optimum - 1e-9);
+						if (solver.capabilities().exact) {
+							TEST_LT(solver.name() + " optimal", std::fabs(defense - optimum), 1e-6);
+						}
+						if (solver.capabilities().approximate) {
+							TEST_TRUE(solver.name() + " within epsilon", defense >= (1 - context.epsilon) * optimum - 1e-9);
+						}
+					}
+				}
+			}
+
+			// Every bounded solver enumerates subsets as the bits of a
+			// uint64_t, and must solve correctly at its declared sizes.
+			for (auto& solver : armor_solvers()) {
+				const ArmorSolverCapabilities& capabilities = solver.capabilities();
+				TEST_LE(solver.name() + " fast_n within max_n", capabilities.fast_n, capabilities.max_n);
+				if (capabilities.max_n == SIZE_MAX) {
+					continue;
+				}
+				TEST_LT(solver.name() + " mask width", capabilities.max_n, 64);
+				TEST_TRUE(solver.name() + " accepts max_n", solver.accepts(capabilities.max_n));
+				TEST_FALSE(solver.name() + " rejects past max_n", solver.accepts(capabilities.max_n + 1));
+
+				auto items = filter_armor_vector(*filtered_armors, 1, 2500, capabilities.fast_n);
+				double optimum_cost, optimum, cost, defense;
+				sum_armor_vector(*tree_knapsack_max_defense(*items, 2500), optimum_cost, optimum);
+				ArmorSolveContext context;
+				sum_armor_vector(*solver.solve(*items, 2500, context), cost, defense);
+				if (capabilities.exact) {
+					TEST_LT(solver.name() + " optimal at fast_n", std::fabs(defense - optimum), 1e-6);
+				} else {
+					TEST_GE(solver.name() + " within epsilon at fast_n", defense, (1 - context.epsilon) * optimum - 1e-9);
+				}
+			}
+
+			// Registration is process-wide; put the registry back afterwards
+			// so later criteria see only the built-in solvers.
+			const std::vector<ArmorSolver> saved = armor_solvers();
+			size_t registered = armor_solvers().size();
+			register_armor_solver(ArmorSolver(
+				"nothing", { false, false, SIZE_MAX, SIZE_MAX },
+				[](const ArmorVector&, double, ArmorSolveContext&) { return std::unique_ptr<ArmorVector>(new ArmorVector); }
+			));
+			register_armor_solver(ArmorSolver(
+				"nothing", { false, false, 10, 10 },
+				[](const ArmorVector&, double, ArmorSolveContext&) { return std::unique_ptr<ArmorVector>(new ArmorVector); }
+			));
+			TEST_EQUAL("registered once", registered + 1, armor_solvers().size());
+			TEST_FALSE("replaced", find_armor_solver("nothing")->accepts(11));
+			TEST_TRUE("solves", find_armor_solver("nothing")->solve(trivial_armors, 100)->empty());
+			armor_solvers() = saved;
+			TEST_FALSE("restored", find_armor_solver("nothing"));
+			TEST_EQUAL("restored size", registered, armor_solvers().size());
+		}
+	);
+
+	//
+	rubric.criterion(
+		"memory-capped solving", 2,
+		[&]()
+		{
+			auto items = filter_armor_vector(*filtered_armors, 1, 2500, 40);
+			double optimum_cost, optimum;
+			sum_armor_vector(*branch_and_bound_max_defense(*items, 2500), optimum_cost, optimum);
+
+			size_t dp_bytes = tree_knapsack_footprint(*items, 2500);
+			TEST_TRUE("dp footprint covers choice bits", dp_bytes >= 40 * 250001 / 8);
+			TEST_TRUE("dp footprint covers a row", dp_bytes >= 250001 * sizeof(double));
+			ArmorDependencies chain(40, -1);
+			for (int i = 1; i < 40; i++) {
+				chain[i] = i - 1;
+			}
+			TEST_TRUE("tree dp footprint covers two rows", tree_knapsack_footprint(*items, 2500, chain) >= 2 * 250001 * sizeof(double));
+
+			ArmorSolveContext roomy;
+			auto dp = find_armor_solver("tree_dp")->solve(*items, 2500, roomy);
+			TEST_EQUAL("no cap", "tree_dp", roomy.path);
+			TEST_EQUAL("predicted", dp_bytes, roomy.predicted_bytes);
+
+			// At 40 items two lean rows outweigh the choice bits, so the lean
+			// DP hands over too.
+			ArmorSolveContext capped;
+			capped.memory_limit = dp_bytes - 1;
+			TEST_TRUE("lean over cap at 40", lean_knapsack_footprint(*items, 2500) > capped.memory_limit);
+			auto fallback = find_armor_solver("tree_dp")->solve(*items, 2500, capped);
+			double cost, defense;
+			sum_armor_vector(*fallback, cost, defense);
+			TEST_EQUAL("fell back", "tree_dp>lean_dp>branch_and_bound", capped.path);
+			TEST_LT("still exact", std::fabs(defense - optimum), 1e-6);
+
+			// At 200 they do not, and the lean DP stays exact.
+			auto many = filter_armor_vector(*filtered_armors, 1, 2500, 200);
+			double many_cost, many_optimum;
+			sum_armor_vector(*branch_and_bound_max_defense(*many, 2500), many_cost, many_optimum);
+			ArmorSolveContext lean;
+			lean.memory_limit = lean_knapsack_footprint(*many, 2500);
+			TEST_TRUE("lean under table DP", lean.memory_limit < tree_knapsack_footprint(*many, 2500));
+			sum_armor_vector(*find_armor_solver("tree_dp")->solve(*many, 2500, lean), cost, defense);
+			TEST_EQUAL("leaner variant", "tree_dp>lean_dp", lean.path);
+			TEST_LT("lean exact", std::fabs(defense - many_optimum), 1e-6);
+
+			ArmorSolveContext tight;
+			tight.epsilon = 0.01;
+			tight.memory_limit = 1 << 16;
+			TEST_TRUE("fptas over cap", fptas_footprint(*items, 2500, 0.01) > tight.memory_limit);
+			auto approximate = find_armor_solver("fptas")->solve(*items, 2500, tight);
+			TEST_EQUAL("fell back to approximation", "fptas>greedy_local", tight.path);
+			TEST_TRUE("approximation fits", armor_solution_fits(*approximate, 2500));
+
+			// Fallbacks that lead back to a solver already tried stop there.
+			// Registration is process-wide, so the registry is put back.
+			const std::vector<ArmorSolver> saved = armor_solvers();
+			register_armor_solver(ArmorSolver(
+				"loop_a", { false, false, SIZE_MAX, SIZE_MAX },
+				[](const ArmorVector&, double, ArmorSolveContext&) { return std::unique_ptr<ArmorVector>(new ArmorVector); },
+				[](const ArmorVector&, double, const ArmorSolveContext&) { return size_t(100); },
+				"loop_b"
+			));
+			register_armor_solver(ArmorSolver(
+				"loop_b", { false, false, SIZE_MAX, SIZE_MAX },
+				[](const ArmorVector&, double, ArmorSolveContext&) { return std::unique_ptr<ArmorVector>(new ArmorVector); },
+				[](const ArmorVector&, double, const ArmorSolveContext&) { return size_t(100); },
+				"loop_a"
+			));
+			ArmorSolveContext looping;
+			looping.memory_limit = 10;
+			find_armor_solver("loop_a")->solve(trivial_armors, 100, looping);
+			armor_solvers() = saved;
+			TEST_EQUAL("loop broken", "loop_a>loop_b", looping.path);
+			TEST_FALSE("restored", find_armor_solver("loop_a") || find_armor_solver("loop_b"));
+		}
+	);
+
+	//
+	rubric.criterion(
+		"catalogue ratio order", 2,
+		[&]()
+		{
+			auto catalogue = load_armor_catalogue("ride.csv");
+			TEST_TRUE("non-null", catalogue);
+			TEST_FALSE("missing file", load_armor_catalogue("no_such_file.csv"));
+			TEST_EQUAL("size", all_armors->size(), catalogue->size());
+			for (size_t k = 0; k + 1 < catalogue->size(); k++) {
+				auto& a = catalogue->armors()[catalogue->by_ratio()[k]];
+				auto& b = catalogue->armors()[catalogue->by_ratio()[k + 1]];
+				if (a->defense() / a->cost() < b->defense() / b->cost()) {
+					TEST_TRUE("sorted", false);
+				}
+			}
+
+			struct Query { double min_defense, max_defense; int total_size; double budget; };
+			std::vector<Query> queries =
+			{
+				{ 1, 2500, 10, 500 },
+				{ 1, 2500, 4000, 2500 },
+				{ 100, 500, 100000, 1000 },
+				{ 481.1, 481.1, 100000, 1000 },
+				{ 500, 100, 100000, 1000 }
+			};
+			for (auto& query : queries) {
+				auto expected = greedy_max_defense(*filter_armor_vector(*all_armors, query.min_defense, query.max_defense, query.total_size), query.budget);
+				auto view = filter_armor_catalogue(*catalogue, query.min_defense, query.max_defense, query.total_size);
+				auto actual = greedy_max_defense_view(*catalogue, view, query.budget);
+				TEST_EQUAL("view size", view.items.size(), view.by_ratio.size());
+				TEST_EQUAL("greedy size", expected->size(), actual->size());
+				for (size_t i = 0; i < expected->size(); i++) {
+					TEST_EQUAL("greedy contents", (*expected)[i]->description(), (*actual)[i]->description());
+				}
+				auto items = armor_view_vector(*catalogue, view);
+				TEST_EQUAL("vector", view.size(), items->size());
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"prefix-incremental greedy", 2,
+		[&]()
+		{
+			ArmorPrefixGreedy sweep;
+			TEST_TRUE("empty", sweep.solve(2500)->empty());
+			for (int size = 200; size <= 4000; size += 200) {
+				auto prefix = filter_armor_vector(*filtered_armors, 1, 2500, size);
+				ArmorVector appended(prefix->begin() + sweep.size(), prefix->end());
+				sweep.append(appended);
+
+				auto expected = greedy_max_defense(*prefix, 2500);
+				auto actual = sweep.solve(2500);
+				TEST_EQUAL("size", size_t(size), sweep.size());
+				TEST_EQUAL("greedy size", expected->size(), actual->size());
+				for (size_t i = 0; i < expected->size(); i++) {
+					TEST_EQUAL("greedy contents", (*expected)[i]->description(), (*actual)[i]->description());
+				}
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"generic solvers", 2,
+		[&]()
+		{
+			auto items = filter_armor_vector(*filtered_armors, 1, 2500, 14);
+			auto greedy_input = filter_armor_vector(*filtered_armors, 1, 2500, 4000);
+			auto catalogue = load_armor_catalogue("ride.csv");
+			auto view = filter_armor_catalogue(*catalogue, 1, 2500, 4000);
+			auto columns = make_armor_columns<double>(*greedy_input);
+
+			const std::string snapshot_path = "maxtime_test.snapshot";
+			TEST_TRUE("save snapshot", save_armor_snapshot(*greedy_input, snapshot_path));
+			ArmorSnapshotMap snapshot;
+			TEST_TRUE("map snapshot", snapshot.open(snapshot_path));
+			std::remove(snapshot_path.c_str());
+			TEST_FALSE("missing snapshot", ArmorSnapshotMap().open("no_such_file.snapshot"));
+			TEST_FALSE("not a snapshot", ArmorSnapshotMap().open("ride.csv"));
+			TEST_EQUAL("snapshot size", greedy_input->size(), snapshot.size());
+			TEST_EQUAL("snapshot description", (*greedy_input)[7]->description(), snapshot.description(7));
+
+			auto expected_greedy = greedy_max_defense(*greedy_input, 2500);
+			auto same_greedy = [&](const std::vector<uint32_t>& actual)
+			{
+				auto chosen = armor_indexes_vector(*greedy_input, actual);
+				TEST_EQUAL("greedy size", expected_greedy->size(), chosen->size());
+				for (size_t i = 0; i < chosen->size(); i++) {
+					TEST_EQUAL("greedy contents", (*expected_greedy)[i]->description(), (*chosen)[i]->description());
+				}
+			};
+			same_greedy(greedy_max_defense_generic<double>(ArmorVectorAccess{ *greedy_input }, 2500));
+			same_greedy(greedy_max_defense_generic<int64_t>(ArmorVectorAccess{ *greedy_input }, 2500));
+			same_greedy(greedy_max_defense_generic<double>(ArmorColumnsAccess<double>{ columns }, 2500));
+			same_greedy(greedy_max_defense_generic<double>(ArmorViewAccess{ *catalogue, view }, 2500));
+			same_greedy(greedy_max_defense_generic<int64_t>(snapshot, 2500));
+
+			auto defense_of = [&](const ArmorVector& armors, const std::vector<uint32_t>& chosen)
+			{
+				double cost, defense;
+				sum_armor_vector(*armor_indexes_vector(armors, chosen), cost, defense);
+				TEST_TRUE("within budget", cost <= 2500);
+				return defense;
+			};
+			double optimal;
+			{
+				double cost;
+				sum_armor_vector(*exhaustive_max_defense(*items, 2500), cost, optimal);
+			}
+			auto items_f = make_armor_columns<float>(*items);
+			ArmorVectorAccess access{ *items };
+			TEST_LT("exhaustive double", std::fabs(optimal - defense_of(*items, exhaustive_max_defense_generic<double>(access, 2500))), 0.01);
+			TEST_LT("exhaustive int64", std::fabs(optimal - defense_of(*items, exhaustive_max_defense_generic<int64_t>(access, 2500))), 0.01);
+			TEST_LT("exhaustive float", std::fabs(optimal - defense_of(*items, exhaustive_max_defense_generic<float>(ArmorColumnsAccess<float>{ items_f }, 2500))), 0.5);
+
+			const int64_t scale = armor_cost_scale(access);
+			TEST_EQUAL("cost scale", armor_cost_scale(*items), scale);
+			TEST_LT("knapsack double", std::fabs(optimal - defense_of(*items, knapsack_max_defense_generic<double>(access, 2500, scale))), 0.01);
+			TEST_LT("knapsack int64", std::fabs(optimal - defense_of(*items, knapsack_max_defense_generic<int64_t>(access, 2500, scale))), 0.01);
+			TEST_TRUE("knapsack empty", knapsack_max_defense_generic<double>(ArmorVectorAccess{ ArmorVector() }, 2500, 1).empty());
+
+			// Both halves round to 0.5f and the budget to 1.0f, so only the
+			// double re-check keeps the pair out.
+			ArmorVector halves;
+			halves.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("a", 0.5000000001, 1.0)));
+			halves.push_back(std::shared_ptr<ArmorItem>(new ArmorItem("b", 0.5000000001, 1.0)));
+			TEST_EQUAL("float greedy within budget", 1, greedy_max_defense_generic<float>(ArmorVectorAccess{ halves }, 1.0000000001).size());
+			TEST_EQUAL("float exhaustive within budget", 1, exhaustive_max_defense_generic<float>(ArmorVectorAccess{ halves }, 1.0000000001).size());
+
+			// The knapsack counts both halves as 0.5 and the budget as 1, so
+			// its answer must be repaired in double too.
+			TEST_EQUAL("knapsack within budget", 1,
+				knapsack_max_defense_generic<double>(ArmorVectorAccess{ halves }, 1.0000000001, armor_cost_scale(halves)).size());
+
+			// Thirds have no exact scale: they are left out of it rather than
+			// forcing 10^6, rounded up by the integer solvers, and handed to
+			// branch and bound by the registry.
+			ArmorVector thirds;
+			for (const char* name : { "a", "b", "c" }) {
+				thirds.push_back(std::shared_ptr<ArmorItem>(new ArmorItem(name, 1.0 / 3, 1.0)));
+			}
+			TEST_EQUAL("thirds scale", 1, armor_cost_scale(thirds));
+			TEST_FALSE("thirds inexact", armor_costs_exact(thirds));
+			TEST_TRUE("cents exact", armor_costs_exact(*items));
+			double thirds_cost, thirds_defense;
+			sum_armor_vector(*tree_knapsack_max_defense(thirds, 1.0), thirds_cost, thirds_defense);
+			TEST_TRUE("thirds DP fits", thirds_cost <= 1.0);
+			TEST_EQUAL("thirds FPTAS", 3, fptas_max_defense(thirds, 1.0, 0.1)->size());
+			for (const char* name : { "tree_dp", "maximal" }) {
+				ArmorSolveContext context;
+				auto solution = find_armor_solver(name)->solve(thirds, 1.0, context);
+				TEST_EQUAL(std::string(name) + " hands thirds to branch and bound", ">branch_and_bound",
+					context.path.substr(context.path.rfind('>')));
+				TEST_EQUAL(std::string(name) + " thirds optimal", 3, solution->size());
+			}
+		}
+	);
+
+	//
+	rubric.criterion(
+		"compile-time static tables", 2,
+		[&]()
+		{
+			auto armors = static_armor_vector(static_armors);
+			TEST_EQUAL("size", static_armors.size(), armors->size());
+			TEST_EQUAL("contents", (*all_armors)[11]->description(), (*armors)[11]->description());
+			TEST_EQUAL("cost", (*all_armors)[11]->cost(), (*armors)[11]->cost());
+
+			auto same = [&](const ArmorVector& expected, const ArmorVector& actual)
+			{
+				TEST_EQUAL("loadout size", expected.size(), actual.size());
+				for (size_t i = 0; i < expected.size() && i < actual.size(); i++) {
+					TEST_EQUAL("loadout contents", expected[i]->description(), actual[i]->description());
+				}
+			};
+			same(*greedy_max_defense(*armors, 1500), *static_loadout_vector(*armors, static_greedy));
+			same(*exhaustive_max_defense(*armors, 1500), *static_loadout_vector(*armors, static_exhaustive));
+
+			for (double budget : { 0.0, 140.17, 500.0, 3000.0, 100000.0 }) {
+				same(*greedy_max_defense(*armors, budget), *static_loadout_vector(*armors, greedy_max_defense_static(static_armors, budget)));
+				same(*exhaustive_max_defense(*armors, budget), *static_loadout_vector(*armors, exhaustive_max_defense_static(static_armors, budget)));
+			}
+
+			constexpr auto unnamed = make_static_armor_table({ { "a", 1.0, 1.0 }, { "", 1.0, 1.0 } });
+			TEST_FALSE("empty description", static_armor_table_valid(unnamed));
+			TEST_TRUE("contains", static_exhaustive.contains(static_exhaustive[0]));
+		}
+	);
+
+	//
+	rubric.criterion(
+		"count-only filter queries", 2,
+		[&]()
+		{
+			ArmorDefenseIndex index(*all_armors);
+			ArmorSelectivity selectivity(*all_armors);
+			TEST_EQUAL("index size", filtered_armors->size(), index.size());
+			TEST_EQUAL("selectivity size", filtered_armors->size(), selectivity.size());
+
+			struct Query { double min_defense, max_defense; int total_size; };
+			std::vector<Query> queries =
+			{
+				{ 100, 500, 10 },
+				{ 100, 500, 100000 },
+				{ 1, 2500, 100000 },
+				{ 481.1, 481.1, 100000 },
+				{ -100, 0, 100000 },
+				{ 500, 100, 100000 },
+				{ 2000, 1e9, 100000 }
+			};
+			const double bucket = double(selectivity.size()) / 64;
+			for (auto& query : queries) {
+				size_t expected = filter_armor_vector(*all_armors, query.min_defense, query.max_defense, query.total_size)->size();
+				TEST_EQUAL("count", expected, index.count(query.min_defense, query.max_defense, query.total_size));
+				if (query.total_size == 100000) {
+					TEST_LT("histogram", std::fabs(selectivity.defense().count(query.min_defense, query.max_defense) - expected), 2 * bucket);
+				}
+			}
+
+			std::vector<ArmorPredicate> predicates(3);
+			predicates[0].min_cost = 300;
+			predicates[0].max_cost = 600;
+			predicates[0].min_defense = 200;
+			predicates[0].max_defense = 500;
+			predicates[1].min_ratio = 1;
+			predicates[1].max_defense = 400;
+			predicates[2].min_cost = 800;
+			predicates[2].min_defense = 600;
+			for (auto& predicate : predicates) {
+				double expected = count_armor_predicate(*all_armors, predicate);
+				TEST_LT("compound estimate", std::fabs(selectivity.estimate(predicate) - expected), 0.1 * expected + 50);
+				TEST_GE("upper estimate", selectivity.upper_estimate(predicate), 0.9 * expected);
+			}
+
+			ArmorPredicate by_cost;
+			by_cost.max_cost = 400;
+			TEST_LT("single column estimate", std::fabs(selectivity.estimate(by_cost) - count_armor_predicate(*all_armors, by_cost)), 2 * bucket);
+			TEST_EQUAL("empty", 0, ArmorSelectivity(ArmorVector()).estimate(predicates[0]));
+		}
+	);
+
+	//
+	rubric.criterion(
+		"branch and bound profile", 2,
+		[&]()
+		{
+			auto items = filter_armor_vector(*filtered_armors, 1, 2500, 40);
+			ArmorSolveContext context;
+			ArmorSearchProfile profile;
+			context.search_profile = &profile;
+			auto expected = branch_and_bound_max_defense(*items, 2500);
+			auto actual = find_armor_solver("branch_and_bound")->solve(*items, 2500, context);
+			TEST_EQUAL("same solution", expected->size(), actual->size());
+
+			TEST_EQUAL("depths", items->size() + 1, profile.depths.size());
+			TEST_EQUAL("root", 1, profile.depths[0].nodes);
+			for (size_t k = 1; k < profile.depths.size(); k++) {
+				const ArmorSearchDepth& parent = profile.depths[k - 1];
+				TEST_EQUAL("children",
+					2 * (parent.nodes - parent.pruned_by_bound) - parent.pruned_by_budget - parent.pruned_by_conflict,
+					profile.depths[k].nodes);
+			}
+			TEST_EQUAL("leaves not pruned", 0, profile.depths.back().pruned_by_bound);
+
+			double cost, defense;
+			sum_armor_vector(*actual, cost, defense);
+			TEST_FALSE("incumbents", profile.incumbents.empty());
+			TEST_LT("last incumbent", std::fabs(profile.incumbents.back().defense - defense), 1e-6);
+			for (size_t i = 1; i < profile.incumbents.size(); i++) {
+				TEST_GT("improving", profile.incumbents[i].defense, profile.incumbents[i - 1].defense);
+				TEST_GT("later", profile.incumbents[i].nodes, profile.incumbents[i - 1].nodes);
+			}
+			TEST_LE("last incumbent node", profile.incumbents.back().nodes, profile.nodes());
+
+			ArmorConflicts conflicts;
+			auto small = filter_armor_vector(*filtered_armors, 1, 2500, 20);
+			for (size_t i = 0; i + 1 < small->size(); i += 2) {
+				add_armor_conflict(conflicts, i, i + 1);
+			}
+			ArmorSearchProfile conflicted;
+			branch_and_bound_max_defense(*small, 2500, conflicts, &conflicted);
+			uint64_t blocked = 0;
+			for (auto& depth : conflicted.depths) {
+				blocked += depth.pruned_by_conflict;
+			}
+			TEST_GT("pruned by conflict", blocked, 0);
+
+			std::stringstream report, folded;
+			write_armor_search_report(profile, report);
+			write_armor_search_flamegraph(profile, folded);
+			size_t lines = 0;
+			for (std::string line; std::getline(folded, line); lines++) {
+				TEST_EQUAL("stack", 0, line.find("branch_and_bound"));
+				TEST_TRUE("count", line.find_last_of(' ') != std::string::npos);
+			}
+			TEST_EQUAL("one stack per depth", profile.depths.size(), lines);
+			TEST_TRUE("report", report.str().find(std::to_string(profile.nodes()) + " nodes") != std::string::npos);
+		}
+	);
+
+	//
+	rubric.criterion(
+		"best-first branch and bound", 2,
+		[&]()
+		{
+			TEST_TRUE("empty", best_first_max_defense(ArmorVector(), 2500)->empty());
+			for (int n : { 10, 40, 200 }) {
+				auto items = filter_armor_vector(*filtered_armors, 1, 2500, n);
+				for (double budget : { 0.0, 500.0, 2500.0, 1e9 }) {
+					double expected_cost, expected;
+					sum_armor_vector(*branch_and_bound_max_defense(*items, budget), expected_cost, expected);
+
+					for (size_t limit : { size_t(0), size_t(2048), SIZE_MAX }) {
+						ArmorBestFirstStats stats;
+						double cost, defense;
+						sum_armor_vector(*best_first_max_defense(*items, budget, limit, &stats), cost, defense);
+						TEST_LE("within budget", cost, budget);
+						TEST_LT("optimal", std::fabs(defense - expected), 1e-6);
+						TEST_LE("memory limit", stats.peak_bytes, limit);
+						if (limit == 0) {
+							TEST_EQUAL("depth first only", 0, stats.nodes);
+						}
+					}
+				}
+			}
+
+			// Subset-sum instances have nearly every bound tied with the
+			// optimum, so a small queue must fill and hand over.
+			ArmorVector subset_sum;
+			for (int i = 0; i < 20; i++) {
+				double cost = 100 + (i * 7919) % 900 + (i * 37 % 100) / 100.0;
+				subset_sum.push_back(std::make_shared<ArmorItem>("item " + std::to_string(i), cost, cost));
+			}
+			double expected_cost, expected;
+			sum_armor_vector(*branch_and_bound_max_defense(subset_sum, 3000.33), expected_cost, expected);
+			ArmorBestFirstStats stats;
+			double cost, defense;
+			sum_armor_vector(*best_first_max_defense(subset_sum, 3000.33, 4096, &stats), cost, defense);
+			TEST_LT("subset-sum optimal", std::fabs(defense - expected), 1e-6);
+			TEST_GT("switched to depth first", stats.depth_first_nodes, 0);
+
+			ArmorSolveContext context;
+			sum_armor_vector(*find_armor_solver("best_first")->solve(subset_sum, 3000.33, context), cost, defense);
+			TEST_LT("registered", std::fabs(defense - expected), 1e-6);
+			TEST_GT("evaluated", context.evaluated, 0);
+		}
+	);
+
+	//
+	rubric.criterion(
+		"ArmorWriter formats", 2,
+		[&]()
+		{
+			ArmorVector empty;
+			std::stringstream printed, written;
+
+			auto saved = std::cout.rdbuf(printed.rdbuf());
+			print_armor_vector(trivial_armors);
+			print_armor_vector(empty);
+			std::cout.rdbuf(saved);
+
+			{
+				ArmorWriter writer(written, ArmorFormat::text, 16);
+				writer.write(trivial_armors);
+				writer.write(empty);
+			}
+			TEST_EQUAL("text matches print_armor_vector", printed.str(), written.str());
+
+			std::stringstream json;
+			{
+				ArmorWriter writer(json, ArmorFormat::json_lines);
+				writer.write(trivial_armors);
+				writer.write(empty);
+			}
+			TEST_EQUAL("jsonl",
+				"{\"items\":[{\"description\":\"test helmet\",\"cost\":100,\"defense\":20},"
+				"{\"description\":\"test boots\",\"cost\":40,\"defense\":5}],\"total_cost\":140,\"total_defense\":25}\n"
+				"{\"items\":[],\"total_cost\":0,\"total_defense\":0}\n",
+				json.str());
+
+			std::stringstream with_gap;
+			{
+				ArmorSolveContext context;
+				auto solution = find_armor_solver("greedy")->solve(trivial_armors, 100, context);
+				ArmorWriter writer(with_gap, ArmorFormat::json_lines);
+				writer.write(*solution, context.gap);
+			}
+			TEST_EQUAL("jsonl gap",
+				"{\"items\":[{\"description\":\"test helmet\",\"cost\":100,\"defense\":20}],"
+				"\"total_cost\":100,\"total_defense\":20,\"upper_bound\":20,\"relative_gap\":0}\n",
+				with_gap.str());
+
+			std::stringstream unbounded;
+			{
+				ArmorSolutionGap gap;
+				gap.upper_bound = INFINITY;
+				ArmorWriter writer(unbounded, ArmorFormat::json_lines);
+				writer.write(empty, gap);
+			}
+			TEST_EQUAL("jsonl non-finite",
+				"{\"items\":[],\"total_cost\":0,\"total_defense\":0,\"upper_bound\":null,\"relative_gap\":null}\n",
+				unbounded.str());
+
+			std::stringstream binary;
+			ArmorWriter writer(binary, ArmorFormat::binary);
+			writer.write(trivial_armors);
+			TEST_TRUE("flush", writer.flush());
+			TEST_EQUAL("binary size", 4 + (4 + 11 + 16) + (4 + 10 + 16) + 16, binary.str().size());
+			TEST_EQUAL("bytes_written", binary.str().size(), writer.bytes_written());
+
+			ArmorFormat format;
+			TEST_TRUE("parse format", parse_armor_format("jsonl", format) && format == ArmorFormat::json_lines);
+			TEST_FALSE("parse format", parse_armor_format("xml", format));
+		}
+	);
+
+	//
+	rubric.criterion(
+		"solve_armor_queries batch", 2,
+		[&]()
+		{
+			const std::string queries_path = "maxtime_test.queries";
+			{
+				std::ofstream f(queries_path);
+				f
+					<< "MinDefense^MaxDefense^TotalSize^Budget^Algorithm\n"
+					<< "1^2500^400^2500^greedy\n"
+					<< "\n"
+					<< "1^2000^12^2000^exhaustive\n"
+					<< "100^500^10^500^greedy\n"
+					;
+			}
+			auto queries = load_armor_queries(queries_path);
+			TEST_TRUE("non-null", queries);
+			TEST_EQUAL("query count", 3, queries->size());
+			TEST_EQUAL("algorithm", "exhaustive", (*queries)[1].algorithm);
+
+			const size_t exhaustive_limit = find_armor_solver("exhaustive")->capabilities().fast_n;
+			for (size_t total_size : { exhaustive_limit, exhaustive_limit + 1 }) {
+				{
+					std::ofstream f(queries_path);
+					f << "header\n1^2000^" << total_size << "^2000^exhaustive\n";
+				}
+				auto limited = load_armor_queries(queries_path);
+				TEST_EQUAL("exhaustive total_size limit", total_size <= exhaustive_limit, bool(limited));
+			}
+			std::remove(queries_path.c_str());
+
+			std::vector<size_t> order;
+			std::vector<ArmorVector> solutions;
+			std::vector<ArmorSolutionGap> gaps;
+			solve_armor_queries(
+				*all_armors, *queries, 3,
+				[&](size_t index, const ArmorVector& solution, const ArmorSolveContext& context)
+				{
+					order.push_back(index);
+					solutions.push_back(solution);
+					gaps.push_back(context.gap);
+				}
+			);
+			TEST_EQUAL("in order", std::vector<size_t>({ 0, 1, 2 }), order);
+			for (size_t q = 0; q < queries->size(); q++) {
+				ArmorSolveContext context;
+				auto expected = solve_armor_query(*all_armors, (*queries)[q], context);
+				TEST_EQUAL("gap upper bound", context.gap.upper_bound, gaps[q].upper_bound);
+				TEST_GE("bound above solution", gaps[q].upper_bound, gaps[q].defense);
+				TEST_LT("gap within bound", gaps[q].relative(), 1.0);
+				TEST_EQUAL("solution size", expected->size(), solutions[q].size());
+				for (size_t i = 0; i < expected->size(); i++) {
+					TEST_EQUAL("solution contents", (*expected)[i]->description(), solutions[q][i]->description());
+				}
+			}
+		}
+	);
+
 	//
 	rubric.criterion(
 		"greedy_max_defense trivial cases", 2,